@@ -0,0 +1,103 @@
+#ifndef ASYNCLOGSINK_H
+#define ASYNCLOGSINK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <spdlog/sinks/sink.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 异步日志sink：写日志的线程只把消息拷进自己的环形缓冲区，
+// 由一个后台线程轮询所有缓冲区，按pattern格式化后成批write到文件。
+// 每个线程一个单生产者单消费者的无锁缓冲区，生产者一侧没有锁和系统调用，
+// 也不唤醒后台线程；后台线程空闲时睡眠kIdleSleepMs，日志最多延迟这么久落盘。
+// 只有kBlock下缓冲区已满、生产者本来就要等待时才会唤醒后台线程。
+// 同一线程的日志保持顺序，不同线程之间按后台线程的轮询顺序交错。
+// 线程的缓冲区在它第一次写日志时创建，归sink所有，线程退出后剩下的照常写出。
+// sink必须比写日志的线程活得更久。
+class AsyncLogSink : public spdlog::sinks::sink {
+  public:
+    // 缓冲区满时的处理方式
+    enum class OverflowPolicy {
+        kDrop,  // 丢弃这条日志并计数，写日志的线程从不等待
+        kBlock, // 让出CPU直到后台线程腾出空间，不丢日志
+    };
+
+    // 各线程计数之和，从构造开始累计
+    struct Metrics {
+        uint64_t written;   // 已写入文件的条数
+        uint64_t dropped;   // kDrop下因缓冲区满丢弃的条数
+        uint64_t blocked;   // kBlock下因缓冲区满等待的次数
+        uint64_t truncated; // 超过单条上限被截断的条数
+    };
+
+    static const size_t kDefaultRingBytes = 1024 * 1024;
+    static const int kIdleSleepMs = 2;
+
+    // 以追加方式打开filename，失败抛出spdlog::spdlog_ex。
+    // ring_bytes是每个线程缓冲区的大小，向上取整为2的幂，
+    // 单条日志最多占其1/4，超出部分截断
+    AsyncLogSink(const std::string &filename,
+                 OverflowPolicy policy = OverflowPolicy::kDrop,
+                 size_t ring_bytes = kDefaultRingBytes);
+    ~AsyncLogSink() override;
+    AsyncLogSink(const AsyncLogSink &) = delete;
+    AsyncLogSink &operator=(const AsyncLogSink &) = delete;
+
+    void log(const spdlog::details::log_msg &msg) override;
+    // 在调用线程中把已经提交的日志全部写出，会阻塞调用方，不要在请求路径上调用
+    void flush() override;
+    void set_pattern(const std::string &pattern) override;
+    void set_formatter(
+        std::unique_ptr<spdlog::formatter> sink_formatter) override;
+
+    Metrics getMetrics();
+
+  private:
+    struct Ring;
+
+    Ring &localRing();
+    // 当前线程第一次写日志时创建它的缓冲区
+    Ring &registerThread();
+    // 把所有缓冲区中的日志格式化写出，返回写出的条数
+    size_t drain();
+    // 在格式化缓冲区末尾追加一条sink自己的日志
+    void appendNotice(spdlog::level::level_enum level, const std::string &text);
+    void writeOut();
+    // kBlock下缓冲区满时叫醒正在睡眠的后台线程
+    void wakeFlusher();
+    void flusherLoop();
+
+    // 每个线程一份，下标是sink的id
+    static thread_local std::vector<Ring *> thread_rings;
+
+    size_t id;
+    OverflowPolicy policy;
+    size_t ring_bytes;
+    int fd;
+
+    std::mutex rings_mutex; // 保护rings
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    // 同一时间只有一个线程消费缓冲区：后台线程或者调用flush的线程。
+    // 以下成员只在持有drain_mutex时访问
+    std::mutex drain_mutex;
+    std::unique_ptr<spdlog::formatter> formatter;
+    std::vector<Ring *> drain_rings; // rings的快照，避免消费时持有rings_mutex
+    spdlog::memory_buf_t out;        // 待write的格式化结果
+    uint64_t reported_dropped;       // 已经在日志文件中报告过的丢弃条数
+
+    std::mutex wake_mutex; // 保护wake_requested
+    std::condition_variable wake_cond;
+    bool wake_requested;
+
+    std::atomic<uint64_t> written;
+    std::atomic<bool> running;
+    std::thread flusher;
+};
+
+#endif // ASYNCLOGSINK_H
@@ -0,0 +1,173 @@
+#include "binaryLog.h"
+#include <chrono>
+#include <fcntl.h>
+#include <mutex>
+#include <new>
+#include <spdlog/details/os.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+const char BinaryLog::kMagic[8] = {'B', 'L', 'O', 'G', 'v', '1', 0, 0};
+const size_t BinaryLog::kHeaderBytes;
+const size_t BinaryLog::kRecordHeaderBytes;
+const uint16_t BinaryLog::kFormatRecordId;
+const size_t BinaryLog::kMaxStringBytes;
+const size_t BinaryLog::kDefaultCapacity;
+const size_t BinaryLog::kDefaultChunkBytes;
+
+std::atomic<bool> BinaryLog::enabled_(false);
+
+static char *mapped = nullptr;
+static size_t mapped_bytes = 0;
+static BinaryLogFileHeader *file_header = nullptr;
+
+// 格式id从1开始，0在chunk中表示后面没有记录
+static std::mutex format_mutex;
+static uint16_t next_format_id = 1;
+
+// 当前线程正在写的chunk，[cur, end)是剩余空间
+struct ThreadChunk {
+    char *cur;
+    char *end;
+    bool exhausted; // 文件已经写满，之后直接丢弃
+};
+
+static thread_local ThreadChunk thread_chunk = {nullptr, nullptr, false};
+
+bool BinaryLog::open(const std::string &path, size_t capacity,
+                     size_t chunk_bytes) {
+    if (mapped != nullptr || chunk_bytes <= kChunkHeaderBytes ||
+        capacity < kHeaderBytes + chunk_bytes) {
+        return false;
+    }
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    size_t chunk_count = (capacity - kHeaderBytes) / chunk_bytes;
+    size_t bytes = kHeaderBytes + chunk_count * chunk_bytes;
+    if (ftruncate(fd, bytes) < 0) {
+        ::close(fd);
+        return false;
+    }
+    void *addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, 0);
+    // 映射建立后fd就不再需要了
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    mapped = static_cast<char *>(addr);
+    mapped_bytes = bytes;
+    file_header = new (mapped) BinaryLogFileHeader();
+    memcpy(file_header->magic, kMagic, sizeof(kMagic));
+    file_header->chunk_bytes = chunk_bytes;
+    file_header->chunk_count = chunk_count;
+    file_header->next_chunk.store(0);
+    file_header->dropped.store(0);
+    enabled_.store(true);
+    return true;
+}
+
+void BinaryLog::close() {
+    if (mapped == nullptr)
+        return;
+    enabled_.store(false);
+    msync(mapped, mapped_bytes, MS_SYNC);
+    munmap(mapped, mapped_bytes);
+    mapped = nullptr;
+    file_header = nullptr;
+    thread_chunk.cur = nullptr;
+    thread_chunk.end = nullptr;
+}
+
+uint64_t BinaryLog::dropped() {
+    return file_header ? file_header->dropped.load() : 0;
+}
+
+char *BinaryLog::reserve(size_t size) {
+    ThreadChunk &chunk = thread_chunk;
+    if (static_cast<size_t>(chunk.end - chunk.cur) >= size) {
+        char *p = chunk.cur;
+        chunk.cur += size;
+        return p;
+    }
+
+    const size_t chunk_bytes = file_header->chunk_bytes;
+    if (chunk.exhausted || size > 0xffff ||
+        size > chunk_bytes - kChunkHeaderBytes) {
+        file_header->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    // 旧chunk剩下的空间保持为0，解码时读到id为0就跳到下一个chunk
+    uint64_t index =
+        file_header->next_chunk.fetch_add(1, std::memory_order_relaxed);
+    if (index >= file_header->chunk_count) {
+        chunk.exhausted = true;
+        chunk.cur = chunk.end = nullptr;
+        file_header->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    char *base = mapped + kHeaderBytes + index * chunk_bytes;
+    uint64_t thread_id = spdlog::details::os::thread_id();
+    memcpy(base, &thread_id, sizeof(thread_id));
+    chunk.cur = base + kChunkHeaderBytes + size;
+    chunk.end = base + chunk_bytes;
+    return base + kChunkHeaderBytes;
+}
+
+uint16_t BinaryLog::registerFormatImpl(spdlog::level::level_enum level,
+                                       const std::string &logger_name,
+                                       const char *file, int line,
+                                       const char *fmt,
+                                       const std::string &types) {
+    uint16_t id;
+    {
+        std::lock_guard<std::mutex> lock(format_mutex);
+        if (next_format_id == kFormatRecordId) {
+            // 格式id用完，这个调用处的记录全部丢弃
+            return kFormatRecordId;
+        }
+        id = next_format_id++;
+    }
+
+    const char *strings[] = {types.c_str(), logger_name.c_str(), file, fmt};
+    size_t size = kRecordHeaderBytes - sizeof(int64_t) + sizeof(uint16_t) +
+                  sizeof(uint8_t) + sizeof(uint32_t);
+    for (const char *s : strings) {
+        size += strlen(s) + 1;
+    }
+    // 登记记录写不进去时不能返回这个id：其他线程的chunk还有空间，
+    // 它们写的记录解码时会找不到格式。丢掉这个调用处，浪费一个id
+    char *p = reserve(size);
+    if (p == nullptr)
+        return kFormatRecordId;
+
+    uint16_t record_id = kFormatRecordId;
+    uint16_t record_size = static_cast<uint16_t>(size);
+    uint8_t record_level = static_cast<uint8_t>(level);
+    uint32_t record_line = static_cast<uint32_t>(line);
+    memcpy(p, &record_id, sizeof(record_id));
+    p += sizeof(record_id);
+    memcpy(p, &record_size, sizeof(record_size));
+    p += sizeof(record_size);
+    memcpy(p, &id, sizeof(id));
+    p += sizeof(id);
+    memcpy(p, &record_level, sizeof(record_level));
+    p += sizeof(record_level);
+    memcpy(p, &record_line, sizeof(record_line));
+    p += sizeof(record_line);
+    for (const char *s : strings) {
+        size_t len = strlen(s) + 1;
+        memcpy(p, s, len);
+        p += len;
+    }
+    return id;
+}
+
+int64_t BinaryLog::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
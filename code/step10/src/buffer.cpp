@@ -0,0 +1,110 @@
+#include "buffer.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+
+const size_t Buffer::kCheapPrepend;
+const size_t Buffer::kInitialSize;
+
+Buffer::Buffer(size_t initial_size)
+    : buffer(kCheapPrepend + initial_size), reader_index(kCheapPrepend),
+      writer_index(kCheapPrepend) {}
+
+size_t Buffer::readableBytes() const { return writer_index - reader_index; }
+
+size_t Buffer::writableBytes() const { return buffer.size() - writer_index; }
+
+size_t Buffer::prependableBytes() const { return reader_index; }
+
+const char *Buffer::peek() const { return begin() + reader_index; }
+
+void Buffer::retrieve(size_t len) {
+    if (len < readableBytes()) {
+        reader_index += len;
+    } else {
+        retrieveAll();
+    }
+}
+
+void Buffer::retrieveAll() {
+    reader_index = kCheapPrepend;
+    writer_index = kCheapPrepend;
+}
+
+std::string Buffer::retrieveAsString(size_t len) {
+    len = std::min(len, readableBytes());
+    std::string result(peek(), len);
+    retrieve(len);
+    return result;
+}
+
+std::string Buffer::retrieveAllAsString() {
+    return retrieveAsString(readableBytes());
+}
+
+void Buffer::append(const char *data, size_t len) {
+    ensureWritableBytes(len);
+    std::copy(data, data + len, beginWrite());
+    hasWritten(len);
+}
+
+void Buffer::append(const std::string &str) { append(str.data(), str.size()); }
+
+void Buffer::prepend(const void *data, size_t len) {
+    assert(len <= prependableBytes());
+    reader_index -= len;
+    const char *d = static_cast<const char *>(data);
+    std::copy(d, d + len, begin() + reader_index);
+}
+
+void Buffer::ensureWritableBytes(size_t len) {
+    if (writableBytes() < len) {
+        makeSpace(len);
+    }
+}
+
+char *Buffer::beginWrite() { return begin() + writer_index; }
+
+void Buffer::hasWritten(size_t len) { writer_index += len; }
+
+ssize_t Buffer::readFd(int fd, int *saved_errno) {
+    char extra_buf[65536];
+    struct iovec vec[2];
+    const size_t writable = writableBytes();
+    vec[0].iov_base = beginWrite();
+    vec[0].iov_len = writable;
+    vec[1].iov_base = extra_buf;
+    vec[1].iov_len = sizeof(extra_buf);
+    // 缓冲区本身已经足够大时不再用临时区，一次最多读这么多
+    const int iovcnt = writable < sizeof(extra_buf) ? 2 : 1;
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    if (n < 0) {
+        *saved_errno = errno;
+    } else if (static_cast<size_t>(n) <= writable) {
+        writer_index += n;
+    } else {
+        // 超出的部分在临时区里，追加进来时才按实际大小扩容
+        writer_index = buffer.size();
+        append(extra_buf, n - writable);
+    }
+    return n;
+}
+
+char *Buffer::begin() { return &*buffer.begin(); }
+
+const char *Buffer::begin() const { return &*buffer.begin(); }
+
+void Buffer::makeSpace(size_t len) {
+    if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
+        buffer.resize(writer_index + len);
+    } else {
+        // 已读部分留下的空间够用，把可读数据挪到前面
+        size_t readable = readableBytes();
+        std::copy(begin() + reader_index, begin() + writer_index,
+                  begin() + kCheapPrepend);
+        reader_index = kCheapPrepend;
+        writer_index = reader_index + readable;
+    }
+}
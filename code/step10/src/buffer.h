@@ -0,0 +1,58 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// 连接的输入/输出缓冲区，布局为
+// | prependable | readable | writable |
+// 0      reader_index  writer_index  size
+// 前面预留kCheapPrepend字节，方便在数据前面补长度等头部而不用搬移数据。
+// 非线程安全，只能在连接所属的EpollManager线程中使用。
+class Buffer {
+  public:
+    static const size_t kCheapPrepend = 8;
+    static const size_t kInitialSize = 1024;
+
+    explicit Buffer(size_t initial_size = kInitialSize);
+
+    size_t readableBytes() const;
+    size_t writableBytes() const;
+    size_t prependableBytes() const;
+
+    // 可读数据的起始位置
+    const char *peek() const;
+    // 消费len字节的可读数据
+    void retrieve(size_t len);
+    void retrieveAll();
+    std::string retrieveAsString(size_t len);
+    std::string retrieveAllAsString();
+
+    void append(const char *data, size_t len);
+    void append(const std::string &str);
+    // 在可读数据前面写入len字节，len不能超过prependableBytes()
+    void prepend(const void *data, size_t len);
+
+    // 确保至少有len字节可写，不够时先挪动已读空间，仍不够再扩容
+    void ensureWritableBytes(size_t len);
+    char *beginWrite();
+    void hasWritten(size_t len);
+
+    // 从fd读数据。用readv同时读到缓冲区的可写空间和栈上64KB的临时区，
+    // 一次系统调用就能读完大消息，而每个连接的缓冲区不用预先开得很大。
+    // 返回read的结果，出错时errno保存在saved_errno中
+    ssize_t readFd(int fd, int *saved_errno);
+
+  private:
+    char *begin();
+    const char *begin() const;
+    void makeSpace(size_t len);
+
+    std::vector<char> buffer;
+    size_t reader_index;
+    size_t writer_index;
+};
+
+#endif // BUFFER_H
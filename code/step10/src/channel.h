@@ -4,6 +4,17 @@
 #include <functional>
 #include <sys/epoll.h>
 
+// Channel事件的另一种处理方式：由连接对象自己实现这组虚函数，
+// 注册时只保存一个指针，不用为每个回调构造std::function（捕获
+// shared_ptr/weak_ptr时会堆分配），分发时也只有一次虚函数调用。
+class EventHandler {
+  public:
+    virtual ~EventHandler() {}
+    virtual void handleRead() = 0;
+    virtual void handleWrite() = 0;
+    virtual void handleError() = 0;
+};
+
 class Channel {
   public:
     using EventCallback = std::function<void()>;
@@ -12,6 +23,9 @@ class Channel {
     void setReadCallback(EventCallback cb);
     void setWriteCallback(EventCallback cb);
     void setErrorCallback(EventCallback cb);
+    // 设置后事件都交给handler，不再调用上面三个回调。Channel不持有handler，
+    // handler析构前必须先置空或从EpollManager注销Channel
+    void setEventHandler(EventHandler *handler);
     void handleEvent();
     void setEvents(uint32_t ev);
     void setRevents(uint32_t rev);
@@ -23,6 +37,7 @@ class Channel {
     int fd;           // 文件描述符
     uint32_t events;  // 注册的事件
     uint32_t revents; // 返回的事件
+    EventHandler *handler;
 
     EventCallback readCallback;  // 读事件回调
     EventCallback writeCallback; // 写事件回调
@@ -0,0 +1,133 @@
+#include "channel.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+// 统计operator new的调用次数，std::function和make_shared都经过这里
+static std::atomic<long> new_calls(0);
+
+void *operator new(size_t size) {
+    new_calls.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+// 模拟一个连接对象，两种方式都把事件转到它的成员函数上
+class Target : public EventHandler {
+  public:
+    Target() : reads(0), writes(0), errors(0) {}
+    void handleRead() override { ++reads; }
+    void handleWrite() override { ++writes; }
+    void handleError() override { ++errors; }
+
+    long reads;
+    long writes;
+    long errors;
+};
+
+// Channel::handleEvent的分发开销测试。
+// function：和改造前的TcpConnection一样，三个std::function各捕获一个
+//           weak_ptr，每次事件先lock再调用；
+// handler：Channel只保存EventHandler指针，每次事件一次虚函数调用。
+// 分别统计建立num_channels个Channel时的分配次数，以及每次分发的耗时。
+class DispatchBench {
+  public:
+    DispatchBench(int num_channels, long iterations);
+    void run();
+
+  private:
+    void run_mode(bool use_handler);
+
+    int num_channels;
+    long iterations;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+DispatchBench::DispatchBench(int num_channels, long iterations)
+    : num_channels(num_channels), iterations(iterations) {
+    logger = spdlog::stdout_color_mt("dispatch_bench");
+}
+
+void DispatchBench::run_mode(bool use_handler) {
+    std::vector<std::shared_ptr<Target>> targets;
+    std::vector<std::shared_ptr<Channel>> channels;
+    targets.reserve(num_channels);
+    channels.reserve(num_channels);
+
+    long before = new_calls.load();
+    for (int i = 0; i < num_channels; ++i) {
+        std::shared_ptr<Target> target = std::make_shared<Target>();
+        std::shared_ptr<Channel> channel = std::make_shared<Channel>(i);
+        if (use_handler) {
+            channel->setEventHandler(target.get());
+        } else {
+            std::weak_ptr<Target> weak_target = target;
+            channel->setReadCallback([weak_target]() {
+                std::shared_ptr<Target> t = weak_target.lock();
+                if (t)
+                    t->handleRead();
+            });
+            channel->setWriteCallback([weak_target]() {
+                std::shared_ptr<Target> t = weak_target.lock();
+                if (t)
+                    t->handleWrite();
+            });
+            channel->setErrorCallback([weak_target]() {
+                std::shared_ptr<Target> t = weak_target.lock();
+                if (t)
+                    t->handleError();
+            });
+        }
+        targets.push_back(target);
+        channels.push_back(channel);
+    }
+    long setup_calls = new_calls.load() - before;
+
+    // 轮流触发各个Channel，读写事件交替出现
+    before = new_calls.load();
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        Channel &channel = *channels[i % num_channels];
+        channel.setRevents((i & 1) ? EPOLLOUT : EPOLLIN);
+        channel.handleEvent();
+    }
+    auto end = std::chrono::steady_clock::now();
+    long dispatch_calls = new_calls.load() - before;
+
+    long handled = 0;
+    for (const std::shared_ptr<Target> &target : targets) {
+        handled += target->reads + target->writes;
+    }
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    logger->info("{:8}: {:.1f} allocations/channel, {:.2f} ns/dispatch, "
+                 "{} allocations while dispatching, {} events handled",
+                 use_handler ? "handler" : "function",
+                 static_cast<double>(setup_calls) / num_channels,
+                 ns / iterations, dispatch_calls, handled);
+}
+
+void DispatchBench::run() {
+    run_mode(false);
+    run_mode(true);
+}
+
+int main(int argc, char *argv[]) {
+    // Channel每次设置回调和分发事件都会输出日志，这里只测分发本身
+    spdlog::set_level(spdlog::level::warn);
+    int num_channels = argc > 1 ? atoi(argv[1]) : 1000;
+    long iterations = argc > 2 ? atol(argv[2]) : 10000000;
+
+    DispatchBench bench(num_channels, iterations);
+    spdlog::get("dispatch_bench")->set_level(spdlog::level::info);
+    bench.run();
+    return 0;
+}
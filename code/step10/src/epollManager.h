@@ -1,15 +1,73 @@
-#include "channel.h" // 假设 Channel 类的定义在这个文件中
+#ifndef EPOLLMANAGER_H
+#define EPOLLMANAGER_H
+
+#include "channel.h"
+#include "timerWheel.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sys/epoll.h>
+#include <thread>
 #include <vector>
 
 class EpollManager {
   public:
-    EpollManager(int max_events);
+    using Functor = std::function<void()>;
+
+    EpollManager(int max_events, int timer_tick_ms = 100);
     ~EpollManager();
-    void add(Channel &channel);
+    // 注册Channel，之后由EpollManager持有它直到remove
+    void add(std::shared_ptr<Channel> channel);
+    // 关注的事件变化后调用，对应EPOLL_CTL_MOD
+    void update(Channel &channel);
+    // 注销Channel并释放所有权，必须在close(fd)之前调用
+    void remove(Channel &channel);
     void wait(int timeout);
+    void loop();
+
+    // 在所属线程中执行cb：当前就是所属线程则立即执行，否则排队并唤醒
+    void runInLoop(Functor cb);
+    // 将cb放入待执行队列，在下一轮wait处理完事件后批量执行
+    void queueInLoop(Functor cb);
+    bool isInLoopThread() const;
+
+    // 定时器接口，只能在所属线程中调用，其他线程请通过runInLoop转交
+    TimerId runAfter(int delay_ms, Functor cb);
+    bool cancelTimer(TimerId id);
+    bool refreshTimer(TimerId id);
+    // 已注册的Channel在idle_ms内没有任何事件则执行cb，每次有事件自动续期，
+    // remove时自动取消
+    void setIdleTimeout(Channel &channel, int idle_ms, Functor cb);
 
   private:
+    // 以fd为下标的Channel表，generation用于识别fd被复用后残留的旧事件
+    struct ChannelSlot {
+        std::shared_ptr<Channel> channel;
+        uint32_t generation;
+        TimerId idle_timer;
+    };
+
+    void wakeup();
+    void handleWakeup();
+    void doPendingFunctors();
+
     int epoll_fd;
     int max_events;
     std::vector<struct epoll_event> events;
+    std::vector<ChannelSlot> channels;
+
+    int wakeup_fd; // eventfd，用于其他线程唤醒阻塞在epoll_wait上的线程
+    std::shared_ptr<Channel> wakeup_channel;
+    std::atomic<std::thread::id> thread_id;
+
+    TimerWheel timer_wheel;
+    std::shared_ptr<Channel> timer_channel;
+
+    std::mutex mutex; // 保护pending_functors
+    std::vector<Functor> pending_functors;
+    // queueInLoop在其他线程里读取
+    std::atomic<bool> calling_pending_functors;
 };
+
+#endif // EPOLLMANAGER_H
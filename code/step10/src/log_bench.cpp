@@ -0,0 +1,115 @@
+#include "asyncLogSink.h"
+#include "binaryLog.h"
+#include "log.h"
+#include "spdlog/sinks/basic_file_sink.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define TEXT_LOG_FILE "log_bench.log"
+#define BINARY_LOG_FILE "log_bench.blog"
+
+// 写日志的开销测试：num_threads个线程各写records条形如
+// "Read {} bytes from fd {}: {}" 的日志，统计写日志线程上每条的平均耗时，
+// 不含后台线程落盘的时间。
+// file：spdlog的basic_file_sink_mt，调用线程格式化后在锁内写文件；
+// async：AsyncLogSink(kBlock)，调用线程格式化消息正文后拷进自己的缓冲区；
+// binary：BinaryLog，调用线程只拷贝格式id、时间戳和原始参数。
+// 测试产生的日志文件在结束时删除。
+class LogBench {
+  public:
+    LogBench(int num_threads, long records);
+    void run();
+
+  private:
+    void run_mode(const char *mode,
+                  const std::shared_ptr<spdlog::logger> &target);
+    void worker(spdlog::logger *target, int index);
+
+    int num_threads;
+    long records;
+    std::string payload;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+LogBench::LogBench(int num_threads, long records)
+    : num_threads(num_threads), records(records), payload(32, 'x') {
+    logger = spdlog::stdout_color_mt("log_bench");
+}
+
+void LogBench::worker(spdlog::logger *target, int index) {
+    spdlog::string_view_t data(payload.data(), payload.size());
+    for (long i = 0; i < records; ++i) {
+        LOGGER_INFO(target, "Read {} bytes from fd {}: {}", i, index, data);
+    }
+}
+
+void LogBench::run_mode(const char *mode,
+                        const std::shared_ptr<spdlog::logger> &target) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([this, &target, i]() { worker(target.get(), i); });
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    logger->info("{:6}: {:.1f} ns/record per thread, {:.2f} M records/s",
+                 mode, ns / records, num_threads * records / ns * 1000);
+}
+
+void LogBench::run() {
+    {
+        std::shared_ptr<spdlog::logger> target =
+            spdlog::basic_logger_mt("file", TEXT_LOG_FILE, true);
+        run_mode("file", target);
+        spdlog::drop("file");
+    }
+    unlink(TEXT_LOG_FILE);
+
+    {
+        std::shared_ptr<AsyncLogSink> sink = std::make_shared<AsyncLogSink>(
+            TEXT_LOG_FILE, AsyncLogSink::OverflowPolicy::kBlock);
+        std::shared_ptr<spdlog::logger> target =
+            std::make_shared<spdlog::logger>("async", sink);
+        run_mode("async", target);
+        sink->flush();
+        AsyncLogSink::Metrics metrics = sink->getMetrics();
+        logger->info("        {} written, {} blocked", metrics.written,
+                     metrics.blocked);
+    }
+    unlink(TEXT_LOG_FILE);
+
+    // 每条记录约60字节，另外每个线程留一个chunk的余量
+    size_t capacity = BinaryLog::kHeaderBytes +
+                      num_threads * (records * 64 +
+                                     2 * BinaryLog::kDefaultChunkBytes);
+    if (!BinaryLog::open(BINARY_LOG_FILE, capacity)) {
+        logger->error("Failed to open {}", BINARY_LOG_FILE);
+        return;
+    }
+    {
+        std::shared_ptr<spdlog::logger> target =
+            std::make_shared<spdlog::logger>("binary");
+        run_mode("binary", target);
+    }
+    logger->info("        {} dropped", BinaryLog::dropped());
+    BinaryLog::close();
+    unlink(BINARY_LOG_FILE);
+}
+
+int main(int argc, char *argv[]) {
+    int num_threads = argc > 1 ? atoi(argv[1]) : 4;
+    long records = argc > 2 ? atol(argv[2]) : 1000000;
+
+    LogBench bench(num_threads, records);
+    bench.run();
+    return 0;
+}
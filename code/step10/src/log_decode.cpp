@@ -0,0 +1,262 @@
+#include "binaryLog.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <fmt/args.h>
+#include <fmt/format.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// 把BinaryLog写的二进制日志还原成文本，格式与spdlog默认pattern相近，
+// 时间精确到微秒，多出一列线程id。各线程的记录合并后按时间戳排序输出。
+// 用法：./step10_log_decode step10_server.blog
+// 服务端还在运行时也可以解码，只会看到已经写进文件的部分。
+class LogDecoder {
+  public:
+    LogDecoder();
+    ~LogDecoder();
+    bool load(const char *path);
+    void decode();
+
+  private:
+    struct Format {
+        bool registered;
+        uint8_t level;
+        uint32_t line;
+        std::string types;
+        std::string logger_name;
+        std::string file;
+        std::string fmt;
+    };
+
+    struct Entry {
+        int64_t time_ns;
+        uint64_t thread_id;
+        uint16_t format_id;
+        const char *args;
+        const char *end;
+    };
+
+    void scanChunk(const char *chunk);
+    void readFormat(const char *p, const char *end);
+    std::string render(const Entry &entry);
+
+    const char *data;
+    size_t size;
+    const BinaryLogFileHeader *header;
+    std::vector<Format> formats; // 下标是格式id
+    std::vector<Entry> entries;
+};
+
+LogDecoder::LogDecoder() : data(nullptr), size(0), header(nullptr) {}
+
+LogDecoder::~LogDecoder() {
+    if (data != nullptr)
+        munmap(const_cast<char *>(data), size);
+}
+
+bool LogDecoder::load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        static_cast<size_t>(st.st_size) < BinaryLog::kHeaderBytes) {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        close(fd);
+        return false;
+    }
+    size = st.st_size;
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    data = static_cast<const char *>(addr);
+    header = reinterpret_cast<const BinaryLogFileHeader *>(data);
+    if (memcmp(header->magic, BinaryLog::kMagic, sizeof(header->magic)) !=
+            0 ||
+        BinaryLog::kHeaderBytes + header->chunk_count * header->chunk_bytes >
+            size) {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        return false;
+    }
+    return true;
+}
+
+void LogDecoder::readFormat(const char *p, const char *end) {
+    uint16_t id;
+    memcpy(&id, p, sizeof(id));
+    p += sizeof(id);
+    if (formats.size() <= id) {
+        formats.resize(id + 1, Format{false, 0, 0, "", "", "", ""});
+    }
+    Format &format = formats[id];
+    format.registered = true;
+    memcpy(&format.level, p, sizeof(format.level));
+    p += sizeof(format.level);
+    memcpy(&format.line, p, sizeof(format.line));
+    p += sizeof(format.line);
+    std::string *strings[] = {&format.types, &format.logger_name, &format.file,
+                              &format.fmt};
+    for (std::string *s : strings) {
+        const char *nul = static_cast<const char *>(memchr(p, '\0', end - p));
+        if (nul == nullptr)
+            return;
+        s->assign(p, nul);
+        p = nul + 1;
+    }
+}
+
+void LogDecoder::scanChunk(const char *chunk) {
+    const char *end = chunk + header->chunk_bytes;
+    uint64_t thread_id;
+    memcpy(&thread_id, chunk, sizeof(thread_id));
+    const char *p = chunk + BinaryLog::kChunkHeaderBytes;
+
+    while (p + sizeof(uint16_t) * 2 <= end) {
+        uint16_t id, record_size;
+        memcpy(&id, p, sizeof(id));
+        memcpy(&record_size, p + sizeof(id), sizeof(record_size));
+        // id为0是chunk中没写过的部分；长度不对说明写到一半进程就退出了
+        if (id == 0 || record_size < sizeof(uint16_t) * 2 ||
+            p + record_size > end) {
+            break;
+        }
+        if (id == BinaryLog::kFormatRecordId) {
+            readFormat(p + sizeof(uint16_t) * 2, p + record_size);
+        } else if (record_size >= BinaryLog::kRecordHeaderBytes) {
+            Entry entry;
+            memcpy(&entry.time_ns, p + sizeof(uint16_t) * 2,
+                   sizeof(entry.time_ns));
+            entry.thread_id = thread_id;
+            entry.format_id = id;
+            entry.args = p + BinaryLog::kRecordHeaderBytes;
+            entry.end = p + record_size;
+            entries.push_back(entry);
+        }
+        p += record_size;
+    }
+}
+
+std::string LogDecoder::render(const Entry &entry) {
+    if (entry.format_id >= formats.size() ||
+        !formats[entry.format_id].registered) {
+        return fmt::format("<unknown format {}>", entry.format_id);
+    }
+    const Format &format = formats[entry.format_id];
+    fmt::dynamic_format_arg_store<fmt::format_context> store;
+    const char *p = entry.args;
+    for (char type : format.types) {
+        switch (type) {
+        case 'b': {
+            store.push_back(*p != 0);
+            p += 1;
+            break;
+        }
+        case 'i': {
+            int64_t v;
+            memcpy(&v, p, sizeof(v));
+            store.push_back(v);
+            p += sizeof(v);
+            break;
+        }
+        case 'u': {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            store.push_back(v);
+            p += sizeof(v);
+            break;
+        }
+        case 'd': {
+            double v;
+            memcpy(&v, p, sizeof(v));
+            store.push_back(v);
+            p += sizeof(v);
+            break;
+        }
+        case 's': {
+            uint16_t len;
+            memcpy(&len, p, sizeof(len));
+            store.push_back(std::string(p + sizeof(len), len));
+            p += sizeof(len) + len;
+            break;
+        }
+        }
+    }
+    if (p != entry.end) {
+        return fmt::format("<corrupt record for format {}: {}>",
+                           entry.format_id, format.fmt);
+    }
+    try {
+        return fmt::vformat(format.fmt, store);
+    } catch (const fmt::format_error &e) {
+        return fmt::format("<{}: {}>", e.what(), format.fmt);
+    }
+}
+
+void LogDecoder::decode() {
+    uint64_t used = std::min<uint64_t>(header->next_chunk.load(),
+                                       header->chunk_count);
+    for (uint64_t i = 0; i < used; ++i) {
+        scanChunk(data + BinaryLog::kHeaderBytes + i * header->chunk_bytes);
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const Entry &a, const Entry &b) {
+                         return a.time_ns < b.time_ns;
+                     });
+
+    for (const Entry &entry : entries) {
+        time_t seconds = static_cast<time_t>(entry.time_ns / 1000000000);
+        struct tm tm;
+        localtime_r(&seconds, &tm);
+        char time_buf[32];
+        strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &tm);
+
+        std::string line = fmt::format("[{}.{:06}] ", time_buf,
+                                       entry.time_ns % 1000000000 / 1000);
+        const char *level = "unknown";
+        std::string location;
+        if (entry.format_id < formats.size() &&
+            formats[entry.format_id].registered) {
+            const Format &format = formats[entry.format_id];
+            if (!format.logger_name.empty())
+                line += fmt::format("[{}] ", format.logger_name);
+            spdlog::string_view_t name = spdlog::level::to_string_view(
+                static_cast<spdlog::level::level_enum>(format.level));
+            level = name.data();
+            size_t slash = format.file.rfind('/');
+            location = fmt::format(
+                "{}:{}",
+                slash == std::string::npos ? format.file
+                                           : format.file.substr(slash + 1),
+                format.line);
+        }
+        line += fmt::format("[{}] [{}] [{}] {}\n", level, entry.thread_id,
+                            location, render(entry));
+        fwrite(line.data(), 1, line.size(), stdout);
+    }
+    fprintf(stderr, "%zu records in %llu chunks, %llu dropped\n",
+            entries.size(), static_cast<unsigned long long>(used),
+            static_cast<unsigned long long>(header->dropped.load()));
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <binary log file>\n", argv[0]);
+        return 1;
+    }
+    LogDecoder decoder;
+    if (!decoder.load(argv[1])) {
+        return 1;
+    }
+    decoder.decode();
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define RESPONSE_PREFIX "server: "
+#define RESPONSE_PREFIX_LEN (sizeof(RESPONSE_PREFIX) - 1)
+
+// 流水线吞吐压测：每个连接一次连续发出depth个请求，不等响应，
+// 然后把这一批的响应全部收回来再发下一批。
+// 服务端会把粘在一起的请求当作一个处理，响应是若干段 "server: " + 请求，
+// 请求内容只有'x'，所以用收到的's'个数就能扣掉前缀，算出回显了多少字节。
+// 分别以 ./step10_server 和 ./step10_server lt 启动服务端对比ET和LT。
+class PipelineBench {
+  public:
+    PipelineBench(const char *server_address, int port, int num_connections,
+                  int depth, int msg_size, int seconds);
+    void run();
+
+  private:
+    void worker();
+    // 发一批请求并收完响应，失败返回false
+    bool one_batch(int sock, const std::string &msg);
+
+    struct sockaddr_in serv_addr;
+    int num_connections;
+    int depth;
+    int msg_size;
+    int seconds;
+    std::atomic<bool> stop;
+    std::atomic<long> requests;
+    std::atomic<long> bytes;
+    std::atomic<long> failures;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+PipelineBench::PipelineBench(const char *server_address, int port,
+                             int num_connections, int depth, int msg_size,
+                             int seconds)
+    : num_connections(num_connections), depth(depth), msg_size(msg_size),
+      seconds(seconds), stop(false), requests(0), bytes(0), failures(0) {
+    logger = spdlog::stdout_color_mt("pipeline_bench");
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_address, &serv_addr.sin_addr) <= 0) {
+        logger->error("Invalid address/ Address not supported");
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool PipelineBench::one_batch(int sock, const std::string &msg) {
+    for (int i = 0; i < depth; ++i) {
+        if (send(sock, msg.data(), msg.size(), MSG_NOSIGNAL) !=
+            static_cast<ssize_t>(msg.size())) {
+            return false;
+        }
+    }
+
+    const long expected = static_cast<long>(depth) * msg.size();
+    long echoed = 0;
+    char buffer[65536];
+    while (echoed < expected) {
+        ssize_t n = read(sock, buffer, sizeof(buffer));
+        if (n <= 0) {
+            return false;
+        }
+        long prefixes = std::count(buffer, buffer + n, 's');
+        echoed += n - prefixes * static_cast<long>(RESPONSE_PREFIX_LEN);
+    }
+    bytes.fetch_add(expected, std::memory_order_relaxed);
+    requests.fetch_add(depth, std::memory_order_relaxed);
+    return true;
+}
+
+void PipelineBench::worker() {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 ||
+        connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        failures.fetch_add(1, std::memory_order_relaxed);
+        if (sock >= 0)
+            close(sock);
+        return;
+    }
+    // 超时说明有数据滞留在服务端没被读到
+    struct timeval tv = {5, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    std::string msg(msg_size, 'x');
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (!one_batch(sock, msg)) {
+            failures.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    close(sock);
+}
+
+void PipelineBench::run() {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_connections; ++i) {
+        threads.emplace_back([this]() { worker(); });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop.store(true);
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    logger->info("connections: {}, depth: {}, msg size: {}, failures: {}, "
+                 "elapsed: {:.2f}s",
+                 num_connections, depth, msg_size, failures.load(), elapsed);
+    logger->info("throughput: {:.0f} req/s, {:.2f} MB/s",
+                 requests.load() / elapsed,
+                 bytes.load() / elapsed / (1024 * 1024));
+}
+
+int main(int argc, char *argv[]) {
+    const char *SERVER_ADDRESS = "127.0.0.1";
+    const int PORT = 8080;
+    int num_connections = argc > 1 ? atoi(argv[1]) : 4;
+    int depth = argc > 2 ? atoi(argv[2]) : 64;
+    int msg_size = argc > 3 ? atoi(argv[3]) : 512;
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+
+    PipelineBench bench(SERVER_ADDRESS, PORT, num_connections, depth, msg_size,
+                        seconds);
+    bench.run();
+
+    return 0;
+}
@@ -1,15 +1,29 @@
+#include "asyncLogSink.h"
+#include "log.h"
 #include "server.h"
 #include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
 
 #define MAX_EVENTS 10
-
-Server::Server(int port, int buffer_size, int max_pending_connections,
-               int max_thread_pools)
-    : port(port), buffer_size(buffer_size),
-      max_pending_connections(max_pending_connections),
-      addrlen(sizeof(address)), thread_pool(max_thread_pools),
-      epoll_manager(MAX_EVENTS) {
-    logger = spdlog::stdout_color_mt("server");
+#define IDLE_TIMEOUT_MS 60000
+#define ACCEPT_METRICS_INTERVAL_MS 5000
+// 单个连接待发送数据的高/低水位，超过高水位暂停读该连接的请求
+#define HIGH_WATER_MARK (1024 * 1024)
+#define LOW_WATER_MARK (256 * 1024)
+#define LOG_FILE "step10_server.log"
+#define BINARY_LOG_FILE "step10_server.blog"
+
+Server::Server(int port, int max_pending_connections, int max_thread_pools,
+               bool edge_triggered)
+    : port(port), max_pending_connections(max_pending_connections),
+      addrlen(sizeof(address)), edge_triggered(edge_triggered),
+      thread_pool(max_thread_pools), epoll_manager(MAX_EVENTS),
+      next_connection_id(0) {
+    // main中开启异步日志时已经注册了同名logger
+    logger = spdlog::get("server");
+    if (!logger)
+        logger = spdlog::stdout_color_mt("server");
     logger->set_level(spdlog::level::info);
     init();
 }
@@ -18,95 +32,197 @@ Server::~Server() { close(server_fd); }
 
 void Server::init() {
     server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == 0) {
-        logger->error("socket creation failed");
+    if (server_fd < 0) {
+        LOGGER_ERROR(logger, "socket creation failed");
         exit(EXIT_FAILURE);
     }
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
 
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        logger->error("bind failed");
+        LOGGER_ERROR(logger, "bind failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
     if (listen(server_fd, max_pending_connections) < 0) {
-        logger->error("listen failed");
+        LOGGER_ERROR(logger, "listen failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
-    auto server_channel = std::make_shared<Channel>(server_fd);
-    server_channel->setEvents(EPOLLIN | EPOLLET);
-    server_channel->setReadCallback(
-        [this, server_channel]() { this->accept_connection(server_channel); });
-    epoll_manager.add(*server_channel);
-
-    logger->info("Server is running and waiting for connections...");
+    acceptor.reset(new Acceptor(&epoll_manager, server_fd));
+    acceptor->setEdgeTriggered(edge_triggered);
+    acceptor->setMetricsInterval(ACCEPT_METRICS_INTERVAL_MS);
+    acceptor->setNewConnectionCallback(
+        [this](int client_fd, const struct sockaddr_in &peer) {
+            this->new_connection(client_fd, peer);
+        });
+    acceptor->start();
+
+    LOGGER_INFO(logger,
+                "Server is running and waiting for connections ({} mode)...",
+                edge_triggered ? "ET" : "LT");
 }
 
 void Server::run() {
-    while (true) {
-        epoll_manager.wait(
-            -1); // `EpollManager` 的 `wait` 方法现在直接调用处理回调
-    }
+    epoll_manager.loop(); // `EpollManager` 的 `wait` 方法现在直接调用处理回调
 }
 
-void Server::accept_connection(std::shared_ptr<Channel> server_channel) {
-    struct sockaddr_in client_addr;
-    socklen_t addrlen = sizeof(client_addr);
-    int client_fd =
-        accept(server_fd, (struct sockaddr *)&client_addr, &addrlen);
-    if (client_fd < 0) {
-        logger->error("accept failed");
-        return;
+void Server::new_connection(int client_fd, const struct sockaddr_in &peer) {
+    // 建连风暴时逐个输出连接信息开销很大，只在debug级别输出
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+    if (logger->should_log(spdlog::level::debug)) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+        LOGGER_DEBUG(logger, "Connection from {}:{}", ip, ntohs(peer.sin_port));
     }
+#else
+    (void)peer;
+#endif
+
+    TcpConnectionPtr conn = std::make_shared<TcpConnection>(
+        &epoll_manager, client_fd, next_connection_id++);
+    conn->setMessageCallback(
+        [this](const TcpConnectionPtr &conn, Buffer *buffer) {
+            this->handle_message(conn, buffer);
+        });
+    conn->setCloseCallback([this](const TcpConnectionPtr &conn) {
+        this->remove_connection(conn);
+    });
+    // 长时间没有任何事件的连接由时间轮超时关闭
+    conn->setIdleTimeout(IDLE_TIMEOUT_MS);
+    conn->setEdgeTriggered(edge_triggered);
+    // 对端读得比发得慢时，先不再读它的请求，响应发出去一部分后再恢复
+    conn->setWaterMarkCallbacks(
+        HIGH_WATER_MARK, LOW_WATER_MARK,
+        [this](const TcpConnectionPtr &conn, size_t pending) {
+            (void)pending; // 只用于日志，编译期去掉日志时没有用到
+            LOGGER_WARN(logger,
+                        "Connection {} has {} bytes pending, pause reading",
+                        conn->getId(), pending);
+            conn->stopRead();
+        },
+        [this](const TcpConnectionPtr &conn, size_t pending) {
+            (void)pending;
+            LOGGER_INFO(logger,
+                        "Connection {} has {} bytes pending, resume reading",
+                        conn->getId(), pending);
+            conn->startRead();
+        });
+    ConnectionState &state = connections[conn->getId()];
+    state.conn = conn;
+    state.busy = false;
+    conn->connectEstablished();
+}
 
-    logger->info("Connection from {}:{}", inet_ntoa(client_addr.sin_addr),
-                 ntohs(client_addr.sin_port));
+void Server::handle_message(const TcpConnectionPtr &conn, Buffer *buffer) {
+    // 协议没有分隔符，目前收到的全部数据作为一个请求
+    std::string request = buffer->retrieveAllAsString();
 
-    auto client_channel = std::make_shared<Channel>(client_fd);
-    client_channel->setEvents(EPOLLIN | EPOLLET);
-    client_channel->setReadCallback(
-        [this, client_channel]() { this->handle_client(client_channel); });
-    epoll_manager.add(*client_channel);
+    auto it = connections.find(conn->getId());
+    if (it == connections.end())
+        return;
+    it->second.requests.push_back(std::move(request));
+    if (!it->second.busy)
+        dispatch_next(conn->getId());
 }
 
-void Server::handle_client(std::shared_ptr<Channel> client_channel) {
-    char buffer[buffer_size] = {0};
-    int valread = read(client_channel->getFd(), buffer, buffer_size);
-    if (valread <= 0) {
-        if (valread == 0) {
-            logger->info("Client disconnected");
-        } else {
-            logger->error("read error");
-        }
-        close(client_channel->getFd());
+// 把连接的下一个请求交给线程池，只在epoll_manager线程中调用
+void Server::dispatch_next(uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end())
+        return;
+    ConnectionState &state = it->second;
+    if (state.requests.empty()) {
+        state.busy = false;
         return;
     }
+    state.busy = true;
+    std::string request = std::move(state.requests.front());
+    state.requests.pop_front();
+
+    // 业务处理交给线程池，socket写操作再交还给EpollManager所在线程
+    // 线程池只持有weak_ptr，连接在此期间关闭则丢弃响应，不会写到被复用的fd上
+    std::weak_ptr<TcpConnection> weak_conn = state.conn;
+    thread_pool.enqueue([this, weak_conn, id, request]() {
+        std::string response = "server: " + request;
+        epoll_manager.queueInLoop([this, weak_conn, id, request, response]() {
+            TcpConnectionPtr conn = weak_conn.lock();
+            if (!conn || !conn->connected()) {
+                LOGGER_DEBUG(logger,
+                             "Connection closed before response was sent");
+                return;
+            }
+            this->send_response(conn, request, response);
+            this->dispatch_next(id);
+        });
+    });
+}
 
-    buffer[valread] = '\0';
-    std::string response = "server: " + std::string(buffer);
-    send(client_channel->getFd(), response.c_str(), response.length(), 0);
-    logger->info("Sent data: {}", response);
-    memset(buffer, 0, buffer_size);
+void Server::send_response(const TcpConnectionPtr &conn,
+                           const std::string &request,
+                           const std::string &response) {
+    conn->send(response);
+    LOGGER_DEBUG(logger, "Sent data: {}", response);
 
-    if (strcmp(buffer, "exit") == 0) {
-        logger->info("Received exit message, closing connection");
-        close(client_channel->getFd());
+    if (request == "exit") {
+        LOGGER_DEBUG(logger, "Received exit message, closing connection");
+        conn->shutdown();
     }
 }
 
-int main() {
+void Server::remove_connection(const TcpConnectionPtr &conn) {
+    connections.erase(conn->getId());
+    // 此时可能还在这个连接的事件回调里，fd放到本轮事件处理完之后再关闭
+    TcpConnectionPtr guard = conn;
+    epoll_manager.queueInLoop([guard]() { guard->connectDestroyed(); });
+}
+
+int main(int argc, char *argv[]) {
     const int PORT = 8080;
-    const int BUFFER_SIZE = 1024;
-    const int MAX_PENDING_CONNECTIONS = 3;
+    const int MAX_PENDING_CONNECTIONS = SOMAXCONN;
     const int THREAD_POOL_SIZE = 5;
 
-    Server server(PORT, BUFFER_SIZE, MAX_PENDING_CONNECTIONS, THREAD_POOL_SIZE);
+    // ./step10_server [lt] [asynclog|asynclog_block|binlog]
+    // lt 使用水平触发，默认边缘触发；
+    // asynclog 把日志异步写到LOG_FILE，缓冲区满时丢弃，asynclog_block 时等待；
+    // binlog 把日志写成二进制记录到BINARY_LOG_FILE，用step10_log_decode查看
+    bool edge_triggered = true;
+    bool async_log = false;
+    bool binary_log = false;
+    AsyncLogSink::OverflowPolicy policy = AsyncLogSink::OverflowPolicy::kDrop;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "lt") == 0) {
+            edge_triggered = false;
+        } else if (strcmp(argv[i], "asynclog") == 0) {
+            async_log = true;
+        } else if (strcmp(argv[i], "asynclog_block") == 0) {
+            async_log = true;
+            policy = AsyncLogSink::OverflowPolicy::kBlock;
+        } else if (strcmp(argv[i], "binlog") == 0) {
+            binary_log = true;
+        }
+    }
+    if (binary_log && !BinaryLog::open(BINARY_LOG_FILE)) {
+        LOG_ERROR("Failed to open binary log {}", BINARY_LOG_FILE);
+        return 1;
+    }
+    if (async_log) {
+        // 默认logger和server的logger共用一个sink，日志由后台线程写文件
+        std::shared_ptr<AsyncLogSink> sink =
+            std::make_shared<AsyncLogSink>(LOG_FILE, policy);
+        spdlog::set_default_logger(std::make_shared<spdlog::logger>("", sink));
+        spdlog::register_logger(
+            std::make_shared<spdlog::logger>("server", sink));
+    }
+
+    Server server(PORT, MAX_PENDING_CONNECTIONS, THREAD_POOL_SIZE,
+                  edge_triggered);
     server.run();
 
     return 0;
@@ -1,19 +1,24 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "acceptor.h"
 #include "channel.h"
 #include "epollManager.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
+#include "tcpConnection.h"
 #include "threadPool.h"
+#include <deque>
+#include <map>
 #include <memory>
 #include <netinet/in.h>
 #include <spdlog/spdlog.h>
+#include <string>
 #include <vector>
 
 class Server {
   public:
-    Server(int port, int buffer_size, int max_pending_connections,
-           int max_thread_pools);
+    Server(int port, int max_pending_connections, int max_thread_pools,
+           bool edge_triggered = true);
     ~Server();
 
     void run();
@@ -21,17 +26,32 @@ class Server {
   private:
     int port;
     int server_fd;
-    int buffer_size;
     int max_pending_connections;
     socklen_t addrlen;
     struct sockaddr_in address;
+    bool edge_triggered; // 监听socket和连接都以EPOLLET注册
     std::shared_ptr<spdlog::logger> logger;
     ThreadPool::ThreadPool thread_pool;
     EpollManager epoll_manager;
+    std::unique_ptr<Acceptor> acceptor;
+    // 连接和它还没处理的请求。同一个连接同时只有一个请求在线程池里，
+    // 响应发出后再交下一个，流水线发来的请求按顺序响应
+    struct ConnectionState {
+        TcpConnectionPtr conn;
+        std::deque<std::string> requests; // 等待交给线程池的请求
+        bool busy; // 线程池里正在处理这个连接的请求
+    };
+    // 所有连接都由这里持有，只在epoll_manager线程中访问
+    std::map<uint64_t, ConnectionState> connections;
+    uint64_t next_connection_id;
 
     void init();
-    void accept_connection(std::shared_ptr<Channel> server_channel);
-    void handle_client(std::shared_ptr<Channel> client_channel);
+    void new_connection(int client_fd, const struct sockaddr_in &peer);
+    void handle_message(const TcpConnectionPtr &conn, Buffer *buffer);
+    void dispatch_next(uint64_t id);
+    void send_response(const TcpConnectionPtr &conn, const std::string &request,
+                       const std::string &response);
+    void remove_connection(const TcpConnectionPtr &conn);
 };
 
 #endif // SERVER_H
@@ -0,0 +1,112 @@
+#ifndef TCPCONNECTION_H
+#define TCPCONNECTION_H
+
+#include "buffer.h"
+#include "channel.h"
+#include "epollManager.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+class TcpConnection;
+using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+
+// 一条已建立的TCP连接，封装Channel、输入/输出缓冲区和空闲超时。
+// 由Server的连接表持有，自己作为Channel的EventHandler处理读写事件。
+// socket是非阻塞的：send写不完的部分留在输出缓冲区，只在有待发数据时
+// 关注EPOLLOUT，可写时由handleWrite继续发送。
+// 关闭流程：handleClose -> close_callback（Server从连接表中删除）
+//          -> 所属EpollManager线程中的connectDestroyed（注销Channel并close fd）
+class TcpConnection : public EventHandler,
+                      public std::enable_shared_from_this<TcpConnection> {
+  public:
+    // buffer中是本次收到的全部未处理数据，处理了多少由回调自己retrieve
+    using MessageCallback =
+        std::function<void(const TcpConnectionPtr &conn, Buffer *buffer)>;
+    using CloseCallback = std::function<void(const TcpConnectionPtr &conn)>;
+    // 输出缓冲区涨到高水位、或从高水位回落到低水位时调用，
+    // 参数是当前待发送的字节数
+    using WaterMarkCallback =
+        std::function<void(const TcpConnectionPtr &conn, size_t pending)>;
+
+    // 边缘触发模式下一次读事件最多读取的字节数
+    static const size_t kDefaultReadBudget = 256 * 1024;
+
+    TcpConnection(EpollManager *loop, int fd, uint64_t id);
+    ~TcpConnection();
+
+    void setMessageCallback(MessageCallback cb);
+    void setCloseCallback(CloseCallback cb);
+    // idle_ms内没有任何事件则关闭连接，需在connectEstablished之前设置
+    void setIdleTimeout(int idle_ms);
+    // 以EPOLLET注册，读写都循环到EAGAIN为止。单次读到read_budget字节后
+    // 先处理已读到的数据，剩下的放到本轮事件之后再读，避免一个连接
+    // 占住整个EpollManager线程。需在connectEstablished之前设置
+    void setEdgeTriggered(bool enable,
+                          size_t read_budget = kDefaultReadBudget);
+    // 待发送数据达到high字节时调用high_cb，之后降到low字节及以下时
+    // 调用low_cb，调用方可以借此暂停/恢复生产数据
+    void setWaterMarkCallbacks(size_t high, size_t low,
+                               WaterMarkCallback high_cb,
+                               WaterMarkCallback low_cb);
+
+    // 以下两个函数必须在所属EpollManager线程中调用
+    void connectEstablished();
+    void connectDestroyed();
+
+    // 可以在任意线程调用，非所属线程时转交给所属线程执行
+    void send(const std::string &data);
+    // 输出缓冲区发送完后再半关闭写端，等对端关闭时释放连接
+    void shutdown();
+    void forceClose();
+
+    // 以下两个函数必须在所属EpollManager线程中调用，用于读方向的流量控制
+    void startRead();
+    void stopRead();
+
+    EpollManager *getLoop() const;
+    int getFd() const;
+    uint64_t getId() const;
+    bool connected() const;
+    // 输出缓冲区中还没写进socket的字节数，只能在所属线程中调用
+    size_t pendingBytes() const;
+
+  private:
+    enum State { kConnecting, kConnected, kDisconnecting, kDisconnected };
+
+    // EventHandler，由Channel在所属EpollManager线程中调用
+    void handleRead() override;
+    void handleWrite() override;
+    void handleError() override;
+
+    // 在本轮事件处理完之后继续读，最多同时投递一次
+    void requeueRead();
+    void handleClose();
+    void sendInLoop(const char *data, size_t len);
+    void shutdownInLoop();
+    // 修改关注的事件并同步给EpollManager
+    void updateEvents(uint32_t events);
+    bool isWriting() const;
+
+    EpollManager *loop;
+    int fd;
+    uint64_t id;
+    State state;
+    int idle_timeout_ms;
+    bool edge_triggered;
+    size_t read_budget;
+    bool read_requeued; // 读预算用完后已经投递了一次继续读的任务
+    size_t high_water_mark;
+    size_t low_water_mark;
+    bool above_high_water; // 已经触发高水位、还没回落到低水位
+    std::shared_ptr<Channel> channel;
+    Buffer input_buffer;
+    Buffer output_buffer;
+    MessageCallback message_callback;
+    CloseCallback close_callback;
+    WaterMarkCallback high_water_callback;
+    WaterMarkCallback low_water_callback;
+};
+
+#endif // TCPCONNECTION_H
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <atomic>
+#include "eventCount.h"
 #include <boost/lockfree/queue.hpp>
 #include <functional>
 #include <future>
@@ -20,6 +21,9 @@ class ThreadPool {
     auto enqueue(F &&f, Args &&...args) -> std::future<decltype(f(args...))>;
 
   private:
+    // 队列空了以后先自旋的轮数，之后在idle上睡眠
+    static const int kSpinRounds = 64;
+
     // 线程需要执行的工作函数
     void worker_thread();
 
@@ -30,6 +34,9 @@ class ThreadPool {
     boost::lockfree::queue<std::function<void()> *> tasks;
 
     std::atomic<bool> stop;
+
+    // 空闲工作线程在这里睡眠，enqueue有睡眠的线程时才唤醒一个
+    EventCount idle;
 };
 
 // 构造函数，启动指定数量的工作线程
@@ -41,6 +48,7 @@ inline ThreadPool::ThreadPool(size_t num_threads) : tasks(128), stop(false) {
 // 析构函数，等待所有线程完成后销毁线程池
 inline ThreadPool::~ThreadPool() {
     stop.store(true);
+    idle.notifyAll();
     for (std::thread &worker : workers)
         worker.join();
 }
@@ -60,19 +68,33 @@ auto ThreadPool::enqueue(F &&f,
     auto wrapped_task = new std::function<void()>([task]() { (*task)(); });
     while (!tasks.push(wrapped_task)) {
     }
+    idle.notifyOne();
 
     return res;
 }
 
-// 工作线程函数，从队列中取出任务并执行
+// 工作线程函数，从队列中取出任务并执行；
+// 队列空了先让出CPU自旋几轮，还是没有任务就睡眠，空闲时不占CPU
 inline void ThreadPool::worker_thread() {
+    int spins = 0;
     while (!stop.load()) {
         std::function<void()> *task;
         if (tasks.pop(task)) {
             (*task)();
             delete task;
-        } else {
+            spins = 0;
+        } else if (spins < kSpinRounds) {
+            ++spins;
             std::this_thread::yield(); // 防止 busy waiting
+        } else {
+            // 登记为等待者之后再检查一次，这之间enqueue的任务不会漏掉
+            EventCount::Key key = idle.prepareWait();
+            if (!tasks.empty() || stop.load()) {
+                idle.cancelWait();
+            } else {
+                idle.wait(key);
+            }
+            spins = 0;
         }
     }
 }
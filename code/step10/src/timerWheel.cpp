@@ -0,0 +1,188 @@
+#include "log.h"
+#include "timerWheel.h"
+#include <cstring>
+#include <stdexcept>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+TimerWheel::TimerWheel(int tick_ms)
+    : tick_ms(tick_ms), current_tick(0), active_count(0), free_list(-1),
+      slots(kLevels * kSlots, -1) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1) {
+        LOG_ERROR("Failed to create timerfd: {}", strerror(errno));
+        throw std::runtime_error("timerfd_create failed");
+    }
+}
+
+TimerWheel::~TimerWheel() { close(timer_fd); }
+
+int TimerWheel::getFd() const { return timer_fd; }
+size_t TimerWheel::size() const { return active_count; }
+
+TimerId TimerWheel::schedule(int delay_ms, TimerCallback cb) {
+    int index;
+    if (free_list != -1) {
+        index = free_list;
+        free_list = timers[index].next;
+    } else {
+        index = static_cast<int>(timers.size());
+        timers.push_back(Timer{0, 0, 0, -1, -1, -1, nullptr});
+    }
+
+    Timer &timer = timers[index];
+    timer.interval = static_cast<uint32_t>((delay_ms + tick_ms - 1) / tick_ms);
+    if (timer.interval == 0)
+        timer.interval = 1;
+    timer.expire = current_tick + timer.interval;
+    timer.callback = std::move(cb);
+    link(index);
+
+    if (active_count++ == 0)
+        arm(true);
+    return (static_cast<uint64_t>(timer.generation) << 32) |
+           static_cast<uint32_t>(index + 1);
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    int index;
+    if (!lookup(id, index))
+        return false;
+    unlink(index);
+    release(index);
+    if (--active_count == 0)
+        arm(false);
+    return true;
+}
+
+bool TimerWheel::refresh(TimerId id) {
+    int index;
+    if (!lookup(id, index))
+        return false;
+    Timer &timer = timers[index];
+    uint64_t expire = current_tick + timer.interval;
+    if (timer.expire != expire) {
+        unlink(index);
+        timer.expire = expire;
+        link(index);
+    }
+    return true;
+}
+
+void TimerWheel::handleRead() {
+    uint64_t expirations = 0;
+    ssize_t n = ::read(timer_fd, &expirations, sizeof(expirations));
+    if (n != sizeof(expirations)) {
+        if (errno != EAGAIN)
+            LOG_ERROR("Failed to read timerfd: {}", strerror(errno));
+        return;
+    }
+    // 线程被阻塞时可能错过多个tick，逐个补上
+    for (uint64_t i = 0; i < expirations && active_count > 0; ++i) {
+        tick();
+    }
+    if (active_count == 0)
+        arm(false);
+}
+
+bool TimerWheel::lookup(TimerId id, int &index) const {
+    index = static_cast<int>(id & 0xffffffff) - 1;
+    if (index < 0 || index >= static_cast<int>(timers.size()))
+        return false;
+    const Timer &timer = timers[index];
+    return timer.list != -1 && timer.generation == (id >> 32);
+}
+
+void TimerWheel::link(int index) {
+    Timer &timer = timers[index];
+    uint64_t expire = timer.expire > current_tick ? timer.expire : current_tick;
+    uint64_t delta = expire - current_tick;
+    if (delta > kMaxDelta) {
+        // 超出时间轮范围的先放到最远的槽，级联下来时会重新计算
+        expire = current_tick + kMaxDelta;
+        delta = kMaxDelta;
+    }
+    // 到期越远放在越高的层，每层的槽位由到期时间对应的位决定
+    int level = 0;
+    while (level < kLevels - 1 && (delta >> ((level + 1) * kSlotBits)) != 0)
+        ++level;
+    uint32_t slot = (expire >> (level * kSlotBits)) & kSlotMask;
+    int list = level * kSlots + slot;
+
+    timer.list = list;
+    timer.prev = -1;
+    timer.next = slots[list];
+    if (timer.next != -1)
+        timers[timer.next].prev = index;
+    slots[list] = index;
+}
+
+void TimerWheel::unlink(int index) {
+    Timer &timer = timers[index];
+    if (timer.prev != -1)
+        timers[timer.prev].next = timer.next;
+    else
+        slots[timer.list] = timer.next;
+    if (timer.next != -1)
+        timers[timer.next].prev = timer.prev;
+    timer.list = -1;
+    timer.prev = timer.next = -1;
+}
+
+void TimerWheel::release(int index) {
+    Timer &timer = timers[index];
+    timer.callback = nullptr;
+    timer.generation++; // 旧句柄从此失效
+    timer.next = free_list;
+    free_list = index;
+}
+
+void TimerWheel::cascade(int level, uint32_t slot) {
+    int list = level * kSlots + slot;
+    int index = slots[list];
+    slots[list] = -1;
+    while (index != -1) {
+        int next = timers[index].next;
+        timers[index].list = -1;
+        link(index);
+        index = next;
+    }
+}
+
+void TimerWheel::tick() {
+    uint32_t index = current_tick & kSlotMask;
+    // 第0层转完一圈，把上一层对应槽里的定时器重新分配下来
+    if (index == 0) {
+        for (int level = 1; level < kLevels; ++level) {
+            uint32_t slot = (current_tick >> (level * kSlotBits)) & kSlotMask;
+            cascade(level, slot);
+            if (slot != 0)
+                break;
+        }
+    }
+
+    // 逐个摘下执行，回调中取消或新增定时器都不会破坏遍历
+    while (slots[index] != -1) {
+        int expired = slots[index];
+        unlink(expired);
+        TimerCallback cb = std::move(timers[expired].callback);
+        release(expired);
+        --active_count;
+        if (cb)
+            cb();
+    }
+    current_tick++;
+}
+
+void TimerWheel::arm(bool enable) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (enable) {
+        spec.it_interval.tv_sec = tick_ms / 1000;
+        spec.it_interval.tv_nsec = (tick_ms % 1000) * 1000000L;
+        spec.it_value = spec.it_interval;
+    }
+    if (timerfd_settime(timer_fd, 0, &spec, nullptr) == -1) {
+        LOG_ERROR("Failed to set timerfd: {}", strerror(errno));
+    }
+}
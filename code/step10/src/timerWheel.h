@@ -0,0 +1,69 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// 定时器句柄，高32位为代数，低32位为槽位下标+1，0表示无效
+using TimerId = uint64_t;
+
+// 分层时间轮：4层，每层64个槽，tick为最小精度。
+// 所有定时器共用一个timerfd，添加/取消/刷新都是O(1)且不产生系统调用，
+// 只有时间轮由空变为非空、或由非空变为空时才会设置一次timerfd。
+// 非线程安全，只能在所属EpollManager的线程中使用。
+class TimerWheel {
+  public:
+    using TimerCallback = std::function<void()>;
+
+    TimerWheel(int tick_ms);
+    ~TimerWheel();
+
+    // 在delay_ms之后执行cb，不足一个tick按一个tick计算
+    TimerId schedule(int delay_ms, TimerCallback cb);
+    // 取消尚未触发的定时器，已触发或已取消返回false
+    bool cancel(TimerId id);
+    // 按原来的时长重新计时，用于空闲连接收到数据后续期
+    bool refresh(TimerId id);
+    // timerfd可读时调用，推进时间轮并执行到期的定时器
+    void handleRead();
+
+    int getFd() const;
+    size_t size() const;
+
+  private:
+    static const int kLevels = 4;
+    static const int kSlotBits = 6;
+    static const uint32_t kSlots = 1 << kSlotBits;
+    static const uint32_t kSlotMask = kSlots - 1;
+    static const uint64_t kMaxDelta = (1ULL << (kLevels * kSlotBits)) - 1;
+
+    struct Timer {
+        uint64_t expire;   // 到期的tick
+        uint32_t interval; // 时长，单位tick
+        uint32_t generation;
+        int prev;
+        int next;
+        int list; // 所在槽位链表，level * kSlots + slot，-1表示不在轮上
+        TimerCallback callback;
+    };
+
+    bool lookup(TimerId id, int &index) const;
+    void link(int index);
+    void unlink(int index);
+    void release(int index);
+    void cascade(int level, uint32_t slot);
+    void tick();
+    void arm(bool enable);
+
+    int timer_fd;
+    int tick_ms;
+    uint64_t current_tick;
+    size_t active_count;
+    int free_list;
+    std::vector<Timer> timers;
+    std::vector<int> slots; // kLevels * kSlots 个链表头
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,112 @@
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// 建连速率压测：多个线程循环 connect -> 收发一次 -> close，
+// 统计每秒完成的连接数。
+// 分别以 ./step11_server 和 ./step11_server reuseport 启动服务端对比两种模式。
+class AcceptBench {
+  public:
+    AcceptBench(const char *server_address, int port, int num_threads,
+                int seconds);
+    void run();
+
+  private:
+    void worker();
+    bool one_connection();
+
+    struct sockaddr_in serv_addr;
+    int num_threads;
+    int seconds;
+    std::atomic<bool> stop;
+    std::atomic<long> connections;
+    std::atomic<long> failures;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+AcceptBench::AcceptBench(const char *server_address, int port,
+                         int num_threads, int seconds)
+    : num_threads(num_threads), seconds(seconds), stop(false), connections(0),
+      failures(0) {
+    logger = spdlog::stdout_color_mt("accept_bench");
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_address, &serv_addr.sin_addr) <= 0) {
+        logger->error("Invalid address/ Address not supported");
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool AcceptBench::one_connection() {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return false;
+    }
+    // close时直接发RST，避免客户端大量TIME_WAIT耗尽本地端口
+    struct linger lg = {1, 0};
+    setsockopt(sock, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+
+    bool ok = false;
+    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == 0) {
+        const char msg[] = "ping";
+        char buffer[64];
+        // 收到回显才算一次完整的建连，确保连接确实被某个Reactor接管
+        if (send(sock, msg, sizeof(msg) - 1, 0) > 0 &&
+            read(sock, buffer, sizeof(buffer)) > 0) {
+            ok = true;
+        }
+    }
+    close(sock);
+    return ok;
+}
+
+void AcceptBench::worker() {
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (one_connection()) {
+            connections.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            failures.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void AcceptBench::run() {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([this]() { worker(); });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop.store(true);
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    logger->info("threads: {}, connections: {}, failures: {}, elapsed: {:.2f}s",
+                 num_threads, connections.load(), failures.load(), elapsed);
+    logger->info("accept rate: {:.0f} conn/s", connections.load() / elapsed);
+}
+
+int main(int argc, char *argv[]) {
+    const char *SERVER_ADDRESS = "127.0.0.1";
+    const int PORT = 8080;
+    int num_threads = argc > 1 ? atoi(argv[1]) : 4;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+
+    AcceptBench bench(SERVER_ADDRESS, PORT, num_threads, seconds);
+    bench.run();
+
+    return 0;
+}
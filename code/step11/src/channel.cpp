@@ -1,39 +1,53 @@
 #include "channel.h"
-#include <spdlog/spdlog.h>
+#include "log.h"
 
-Channel::Channel(int fd) : fd(fd), events(0), revents(0) {
-    spdlog::info("Channel created for fd: {}", fd);
+Channel::Channel(int fd) : fd(fd), events(0), revents(0), handler(nullptr) {
+    LOG_DEBUG("Channel created for fd: {}", fd);
 }
 
 void Channel::setReadCallback(EventCallback cb) {
     readCallback = std::move(cb);
-    spdlog::info("Read callback set for fd: {}", fd);
+    LOG_DEBUG("Read callback set for fd: {}", fd);
 }
 
 void Channel::setWriteCallback(EventCallback cb) {
     writeCallback = std::move(cb);
-    spdlog::info("Write callback set for fd: {}", fd);
+    LOG_DEBUG("Write callback set for fd: {}", fd);
 }
 
 void Channel::setErrorCallback(EventCallback cb) {
     errorCallback = std::move(cb);
-    spdlog::info("Error callback set for fd: {}", fd);
+    LOG_DEBUG("Error callback set for fd: {}", fd);
+}
+
+void Channel::setEventHandler(EventHandler *handler) {
+    this->handler = handler;
 }
 
 void Channel::handleEvent() {
-    spdlog::debug("Handling events for fd: {}", fd);
+    LOG_TRACE("Handling events for fd: {}", fd);
+    if (handler) {
+        // 与回调方式的顺序一致：先错误，再读，最后写
+        if (revents & (EPOLLERR | EPOLLHUP))
+            handler->handleError();
+        if (revents & EPOLLIN)
+            handler->handleRead();
+        if (revents & EPOLLOUT)
+            handler->handleWrite();
+        return;
+    }
     if (revents & (EPOLLERR | EPOLLHUP)) {
-        spdlog::error("Error or hangup on fd: {}", fd);
+        LOG_DEBUG("Error or hangup on fd: {}", fd);
         if (errorCallback)
             errorCallback();
     }
     if (revents & EPOLLIN) {
-        spdlog::info("Read event for fd: {}", fd);
+        LOG_TRACE("Read event for fd: {}", fd);
         if (readCallback)
             readCallback();
     }
     if (revents & EPOLLOUT) {
-        spdlog::info("Write event for fd: {}", fd);
+        LOG_TRACE("Write event for fd: {}", fd);
         if (writeCallback)
             writeCallback();
     }
@@ -41,12 +55,12 @@ void Channel::handleEvent() {
 
 void Channel::setEvents(uint32_t ev) {
     events = ev;
-    spdlog::info("Events set for fd: {}, events: {}", fd, events);
+    LOG_DEBUG("Events set for fd: {}, events: {}", fd, events);
 }
 
 void Channel::setRevents(uint32_t rev) {
     revents = rev;
-    spdlog::info("Revents set for fd: {}, revents: {}", fd, revents);
+    LOG_TRACE("Revents set for fd: {}, revents: {}", fd, revents);
 }
 
 int Channel::getFd() const { return fd; }
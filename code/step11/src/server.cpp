@@ -1,18 +1,31 @@
+#include "asyncLogSink.h"
+#include "log.h"
 #include "server.h"
 
 #include <arpa/inet.h>
+#include <cstring>
 #include <spdlog/sinks/stdout_color_sinks.h>
-#include <spdlog/spdlog.h>
 #include <unistd.h>
 
 #define MAX_EVENTS 10
+#define IDLE_TIMEOUT_MS 60000
+#define ACCEPT_METRICS_INTERVAL_MS 5000
+// 单个连接待发送数据的高/低水位，超过高水位暂停读该连接的请求
+#define HIGH_WATER_MARK (1024 * 1024)
+#define LOW_WATER_MARK (256 * 1024)
+#define LOG_FILE "step11_server.log"
+#define BINARY_LOG_FILE "step11_server.blog"
 
 Server::Server(int port, int buffer_size, int max_pending_connections,
-               int num_reactor_threads)
+               int num_reactor_threads, bool reuse_port)
     : port(port), buffer_size(buffer_size),
       max_pending_connections(max_pending_connections),
-      addrlen(sizeof(address)), next_reactor(0) {
-    logger = spdlog::stdout_color_mt("server");
+      addrlen(sizeof(address)), reuse_port(reuse_port), next_reactor(0),
+      next_connection_id(0) {
+    // main中开启异步日志时已经注册了同名logger
+    logger = spdlog::get("server");
+    if (!logger)
+        logger = spdlog::stdout_color_mt("server");
     logger->set_level(spdlog::level::info);
     reactor_threads.resize(num_reactor_threads);
     for (int i = 0; i < num_reactor_threads; ++i) {
@@ -22,106 +35,211 @@ Server::Server(int port, int buffer_size, int max_pending_connections,
     init();
 }
 
-Server::~Server() { close(server_fd); }
+Server::~Server() {
+    for (int fd : listen_fds) {
+        close(fd);
+    }
+    for (std::thread &t : loop_threads) {
+        if (t.joinable())
+            t.join();
+    }
+}
 
-void Server::init() {
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == 0) {
-        logger->error("socket creation failed");
+int Server::create_listen_socket() {
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        LOGGER_ERROR(logger, "socket creation failed");
         exit(EXIT_FAILURE);
     }
 
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    // 多个socket绑定同一端口，由内核按四元组哈希把新连接分散到各个监听队列
+    if (reuse_port &&
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) <
+            0) {
+        LOGGER_ERROR(logger, "setsockopt SO_REUSEPORT failed");
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
 
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        logger->error("bind failed");
+        LOGGER_ERROR(logger, "bind failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
     if (listen(server_fd, max_pending_connections) < 0) {
-        logger->error("listen failed");
+        LOGGER_ERROR(logger, "listen failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
+    return server_fd;
+}
 
-    auto server_channel = std::make_shared<Channel>(server_fd);
-    server_channel->setEvents(EPOLLIN);
-    server_channel->setReadCallback([this, server_channel]() {
-        logger->info("Connecting...");
-        this->accept_connection(server_channel);
-    });
+void Server::init() {
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
 
-    reactor_threads[0]->add(*server_channel);
+    // reuse_port模式下每个Reactor都有自己的监听socket，否则只有主Reactor监听
+    size_t num_acceptors = reuse_port ? reactor_threads.size() : 1;
+    for (size_t i = 0; i < num_acceptors; ++i) {
+        int server_fd = create_listen_socket();
+        listen_fds.push_back(server_fd);
+
+        EpollManager *reactor = reactor_threads[i].get();
+        std::unique_ptr<Acceptor> acceptor(new Acceptor(reactor, server_fd));
+        acceptor->setMetricsInterval(ACCEPT_METRICS_INTERVAL_MS);
+        acceptor->setNewConnectionCallback(
+            [this, reactor](int client_fd, const struct sockaddr_in &peer) {
+                this->new_connection(client_fd, peer, reactor);
+            });
+        acceptor->start();
+        acceptors.push_back(std::move(acceptor));
+    }
 
-    logger->info("Server is running and waiting for connections...");
+    LOGGER_INFO(logger,
+                "Server is running and waiting for connections, "
+                "{} acceptor(s)",
+                num_acceptors);
 }
 
 void Server::run() {
-    while (true) {
-        for (auto &reactor : reactor_threads) {
-            reactor->wait(100); // 每个Reactor线程处理自己的事件
-        }
+    // 每个子Reactor运行在自己的线程上，互不阻塞
+    for (size_t i = 1; i < reactor_threads.size(); ++i) {
+        EpollManager *reactor = reactor_threads[i].get();
+        loop_threads.emplace_back([reactor]() { reactor->loop(); });
     }
+    LOGGER_INFO(logger, "Started {} sub reactor threads", loop_threads.size());
+
+    // 主Reactor运行在当前线程上
+    reactor_threads[0]->loop();
 }
 
-void Server::accept_connection(std::shared_ptr<Channel> server_channel) {
-    struct sockaddr_in client_addr;
-    socklen_t addrlen = sizeof(client_addr);
-    int client_fd =
-        accept(server_fd, (struct sockaddr *)&client_addr, &addrlen);
-    if (client_fd < 0) {
-        logger->error("accept failed");
-        return;
+void Server::new_connection(int client_fd, const struct sockaddr_in &peer,
+                            EpollManager *acceptor) {
+    // 建连风暴时逐个输出连接信息开销很大，只在debug级别输出
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+    if (logger->should_log(spdlog::level::debug)) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+        LOGGER_DEBUG(logger, "Connection from {}:{}", ip, ntohs(peer.sin_port));
+    }
+#else
+    (void)peer;
+#endif
+
+    // reuse_port模式下连接留在accept它的Reactor上，不需要跨线程投递；
+    // 否则轮询分发给子Reactor
+    EpollManager *reactor = acceptor;
+    if (!reuse_port && reactor_threads.size() > 1) {
+        int reactor_index = 1 + next_reactor++ % (reactor_threads.size() - 1);
+        reactor = reactor_threads[reactor_index].get();
     }
 
-    logger->info("Connection from {}:{}", inet_ntoa(client_addr.sin_addr),
-                 ntohs(client_addr.sin_port));
-
-    auto client_channel = std::make_shared<Channel>(client_fd);
-    client_channel->setEvents(EPOLLIN);
-    client_channel->setReadCallback(
-        [this, client_channel]() { this->handle_client(client_channel); });
-
-    int reactor_index = next_reactor++ % reactor_threads.size();
-    reactor_threads[reactor_index]->add(*client_channel);
-}
-
-void Server::handle_client(std::shared_ptr<Channel> client_channel) {
-    char buffer[buffer_size] = {0};
-    int valread = read(client_channel->getFd(), buffer, buffer_size - 1);
-    if (valread <= 0) {
-        if (valread == 0) {
-            logger->info("Client disconnected");
-        } else {
-            logger->error("read error");
-        }
-        close(client_channel->getFd());
-        return;
+    // reuse_port模式下多个Reactor并发accept，连接id和连接表都在锁内更新
+    TcpConnectionPtr conn;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        conn = std::make_shared<TcpConnection>(reactor, client_fd,
+                                               next_connection_id++);
+        connections[conn->getId()] = conn;
     }
+    conn->setMessageCallback(
+        [this](const TcpConnectionPtr &conn, Buffer *buffer) {
+            this->handle_message(conn, buffer);
+        });
+    conn->setCloseCallback([this](const TcpConnectionPtr &conn) {
+        this->remove_connection(conn);
+    });
+    conn->setIdleTimeout(IDLE_TIMEOUT_MS);
+    // 对端读得比发得慢时，先不再读它的请求，响应发出去一部分后再恢复
+    conn->setWaterMarkCallbacks(
+        HIGH_WATER_MARK, LOW_WATER_MARK,
+        [this](const TcpConnectionPtr &conn, size_t pending) {
+            (void)pending; // 只用于日志，编译期去掉日志时没有用到
+            LOGGER_WARN(logger,
+                        "Connection {} has {} bytes pending, pause reading",
+                        conn->getId(), pending);
+            conn->stopRead();
+        },
+        [this](const TcpConnectionPtr &conn, size_t pending) {
+            (void)pending;
+            LOGGER_INFO(logger,
+                        "Connection {} has {} bytes pending, resume reading",
+                        conn->getId(), pending);
+            conn->startRead();
+        });
+
+    // 注册Channel和设置空闲超时都在所属Reactor自己的线程中执行
+    reactor->runInLoop([conn]() { conn->connectEstablished(); });
+}
 
-    buffer[valread] = '\0';
-    std::string response = "server: " + std::string(buffer);
-    send(client_channel->getFd(), response.c_str(), response.length(), 0);
-    logger->info("Sent data: {}", response);
+void Server::handle_message(const TcpConnectionPtr &conn, Buffer *buffer) {
+    // 协议没有分隔符，目前收到的全部数据作为一个请求
+    std::string request = buffer->retrieveAllAsString();
+    std::string response = "server: " + request;
+    conn->send(response);
+    LOGGER_DEBUG(logger, "Sent data: {}", response);
 
-    if (strcmp(buffer, "exit") == 0) {
-        logger->info("Received exit message, closing connection");
-        close(client_channel->getFd());
+    if (request == "exit") {
+        LOGGER_DEBUG(logger, "Received exit message, closing connection");
+        conn->shutdown();
     }
+}
 
-    memset(buffer, 0, buffer_size); // 清空buffer放在最后
+void Server::remove_connection(const TcpConnectionPtr &conn) {
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        connections.erase(conn->getId());
+    }
+    // 此时可能还在这个连接的事件回调里，fd放到本轮事件处理完之后再关闭
+    TcpConnectionPtr guard = conn;
+    conn->getLoop()->queueInLoop([guard]() { guard->connectDestroyed(); });
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     const int PORT = 8080;
     const int BUFFER_SIZE = 1024;
-    const int MAX_PENDING_CONNECTIONS = 3;
-    const int THREAD_POOL_SIZE = 5;
+    const int MAX_PENDING_CONNECTIONS = SOMAXCONN;
+    const int NUM_REACTOR_THREADS = 5; // 1个主Reactor + 4个子Reactor
+
+    // ./step11_server [reuseport] [asynclog|asynclog_block|binlog]
+    // reuseport 开启每个Reactor独立监听的模式；
+    // asynclog 把日志异步写到LOG_FILE，缓冲区满时丢弃，asynclog_block 时等待；
+    // binlog 把日志写成二进制记录到BINARY_LOG_FILE，用step11_log_decode查看
+    bool reuse_port = false;
+    bool async_log = false;
+    bool binary_log = false;
+    AsyncLogSink::OverflowPolicy policy = AsyncLogSink::OverflowPolicy::kDrop;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "reuseport") == 0) {
+            reuse_port = true;
+        } else if (strcmp(argv[i], "asynclog") == 0) {
+            async_log = true;
+        } else if (strcmp(argv[i], "asynclog_block") == 0) {
+            async_log = true;
+            policy = AsyncLogSink::OverflowPolicy::kBlock;
+        } else if (strcmp(argv[i], "binlog") == 0) {
+            binary_log = true;
+        }
+    }
+    if (binary_log && !BinaryLog::open(BINARY_LOG_FILE)) {
+        LOG_ERROR("Failed to open binary log {}", BINARY_LOG_FILE);
+        return 1;
+    }
+    if (async_log) {
+        // 默认logger和server的logger共用一个sink，日志由后台线程写文件
+        std::shared_ptr<AsyncLogSink> sink =
+            std::make_shared<AsyncLogSink>(LOG_FILE, policy);
+        spdlog::set_default_logger(std::make_shared<spdlog::logger>("", sink));
+        spdlog::register_logger(
+            std::make_shared<spdlog::logger>("server", sink));
+    }
 
-    Server server(PORT, BUFFER_SIZE, MAX_PENDING_CONNECTIONS, THREAD_POOL_SIZE);
+    Server server(PORT, BUFFER_SIZE, MAX_PENDING_CONNECTIONS,
+                  NUM_REACTOR_THREADS, reuse_port);
     server.run();
 
     return 0;
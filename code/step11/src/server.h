@@ -1,34 +1,52 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "acceptor.h"
 #include "channel.h"
 #include "epollManager.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
+#include "tcpConnection.h"
 #include "threadPool.h"
+#include <map>
 #include <memory>
+#include <mutex>
 #include <netinet/in.h>
 #include <spdlog/spdlog.h>
+#include <thread>
 #include <vector>
 
 class Server {
   public:
     Server(int port, int buffer_size, int max_pending_connections,
-           int num_reactor_threads);
+           int num_reactor_threads, bool reuse_port = false);
     ~Server();
     void init();
     void run();
-    void accept_connection(std::shared_ptr<Channel> server_channel);
-    void handle_client(std::shared_ptr<Channel> client_channel);
+    void new_connection(int client_fd, const struct sockaddr_in &peer,
+                        EpollManager *acceptor);
+    void handle_message(const TcpConnectionPtr &conn, Buffer *buffer);
+    void remove_connection(const TcpConnectionPtr &conn);
 
   private:
-    int server_fd;
+    int create_listen_socket();
+
+    std::vector<int> listen_fds;
     int port;
     int buffer_size;
     int max_pending_connections;
     socklen_t addrlen;
     struct sockaddr_in address;
+    // reactor_threads[0] 为主Reactor，负责accept；其余为子Reactor，处理连接读写
     std::vector<std::unique_ptr<EpollManager>> reactor_threads;
+    std::vector<std::thread> loop_threads;
+    // 每个监听socket一个Acceptor，运行在监听它的Reactor上
+    std::vector<std::unique_ptr<Acceptor>> acceptors;
+    bool reuse_port;
     int next_reactor;
+    // 连接在accept线程中加入、在所属子Reactor线程中删除，需要加锁
+    std::mutex connections_mutex;
+    std::map<uint64_t, TcpConnectionPtr> connections;
+    uint64_t next_connection_id;
     std::shared_ptr<spdlog::logger> logger;
 };
 
@@ -0,0 +1,280 @@
+#include "log.h"
+#include "tcpConnection.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const size_t TcpConnection::kDefaultReadBudget;
+
+TcpConnection::TcpConnection(EpollManager *loop, int fd, uint64_t id)
+    : loop(loop), fd(fd), id(id), state(kConnecting), idle_timeout_ms(0),
+      edge_triggered(false), read_budget(kDefaultReadBudget),
+      read_requeued(false), high_water_mark(0), low_water_mark(0),
+      above_high_water(false),
+      channel(std::make_shared<Channel>(fd)) {
+    // 写不完时不能阻塞整个EpollManager线程
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+TcpConnection::~TcpConnection() {
+    channel->setEventHandler(nullptr);
+    LOG_DEBUG("TcpConnection {} destroyed, fd: {}", id, fd);
+}
+
+void TcpConnection::setMessageCallback(MessageCallback cb) {
+    message_callback = std::move(cb);
+}
+
+void TcpConnection::setCloseCallback(CloseCallback cb) {
+    close_callback = std::move(cb);
+}
+
+void TcpConnection::setIdleTimeout(int idle_ms) { idle_timeout_ms = idle_ms; }
+
+void TcpConnection::setEdgeTriggered(bool enable, size_t read_budget) {
+    edge_triggered = enable;
+    this->read_budget = read_budget;
+}
+
+void TcpConnection::setWaterMarkCallbacks(size_t high, size_t low,
+                                          WaterMarkCallback high_cb,
+                                          WaterMarkCallback low_cb) {
+    high_water_mark = high;
+    low_water_mark = low;
+    high_water_callback = std::move(high_cb);
+    low_water_callback = std::move(low_cb);
+}
+
+void TcpConnection::connectEstablished() {
+    state = kConnected;
+    channel->setEvents(edge_triggered ? EPOLLIN | EPOLLET : EPOLLIN);
+    // Channel只保存裸指针。连接由Server的连接表持有，并且总是先在
+    // connectDestroyed中注销Channel再析构，分发事件时连接一定还活着
+    channel->setEventHandler(this);
+    loop->add(channel);
+
+    if (idle_timeout_ms > 0) {
+        std::weak_ptr<TcpConnection> weak_conn = shared_from_this();
+        loop->setIdleTimeout(*channel, idle_timeout_ms, [weak_conn]() {
+            TcpConnectionPtr conn = weak_conn.lock();
+            if (!conn)
+                return;
+            LOG_INFO("Connection idle timeout, fd: {}", conn->fd);
+            conn->handleClose();
+        });
+    }
+}
+
+void TcpConnection::connectDestroyed() {
+    state = kDisconnected;
+    // 先从EpollManager注销Channel（同时取消空闲定时器），再关闭fd
+    loop->remove(*channel);
+    close(fd);
+}
+
+void TcpConnection::send(const std::string &data) {
+    if (loop->isInLoopThread()) {
+        sendInLoop(data.data(), data.size());
+        return;
+    }
+    TcpConnectionPtr self = shared_from_this();
+    loop->runInLoop(
+        [self, data]() { self->sendInLoop(data.data(), data.size()); });
+}
+
+void TcpConnection::shutdown() {
+    if (loop->isInLoopThread()) {
+        shutdownInLoop();
+        return;
+    }
+    TcpConnectionPtr self = shared_from_this();
+    loop->runInLoop([self]() { self->shutdownInLoop(); });
+}
+
+void TcpConnection::forceClose() {
+    if (loop->isInLoopThread()) {
+        handleClose();
+        return;
+    }
+    TcpConnectionPtr self = shared_from_this();
+    loop->runInLoop([self]() { self->handleClose(); });
+}
+
+void TcpConnection::startRead() {
+    if (state == kDisconnected || (channel->getEvents() & EPOLLIN))
+        return;
+    updateEvents(channel->getEvents() | EPOLLIN);
+}
+
+void TcpConnection::stopRead() {
+    if (state == kDisconnected || !(channel->getEvents() & EPOLLIN))
+        return;
+    updateEvents(channel->getEvents() & ~EPOLLIN);
+}
+
+EpollManager *TcpConnection::getLoop() const { return loop; }
+
+int TcpConnection::getFd() const { return fd; }
+
+uint64_t TcpConnection::getId() const { return id; }
+
+bool TcpConnection::connected() const { return state == kConnected; }
+
+size_t TcpConnection::pendingBytes() const {
+    return output_buffer.readableBytes();
+}
+
+void TcpConnection::handleRead() {
+    // kDisconnecting时仍要读，才能读到对端关闭
+    if (state == kDisconnected)
+        return;
+    int saved_errno = 0;
+    size_t total = 0;
+    ssize_t n;
+    // 水平触发每次事件读一次即可；边缘触发只通知一次，必须读到EAGAIN，
+    // 否则剩下的数据要等对端再发才能读到
+    do {
+        n = input_buffer.readFd(fd, &saved_errno);
+        if (n > 0)
+            total += n;
+    } while (edge_triggered && total < read_budget &&
+             (n > 0 || (n < 0 && saved_errno == EINTR)));
+
+    if (total > 0) {
+        // 预算用完时还没读到EAGAIN，先处理已读到的数据，本轮事件之后再接着读
+        if (edge_triggered && n > 0)
+            requeueRead();
+        if (message_callback)
+            message_callback(shared_from_this(), &input_buffer);
+    }
+    if (n == 0) {
+        LOG_DEBUG("Client disconnected, fd: {}", fd);
+        handleClose();
+    } else if (n < 0 && saved_errno != EAGAIN && saved_errno != EINTR) {
+        LOG_ERROR("read error on fd {}: {}", fd, strerror(saved_errno));
+        handleClose();
+    }
+}
+
+void TcpConnection::requeueRead() {
+    if (read_requeued)
+        return;
+    read_requeued = true;
+    std::weak_ptr<TcpConnection> weak_conn = shared_from_this();
+    loop->queueInLoop([weak_conn]() {
+        TcpConnectionPtr conn = weak_conn.lock();
+        if (!conn)
+            return;
+        conn->read_requeued = false;
+        // 读被暂停（高水位）时不再继续读，由startRead恢复
+        if (conn->channel->getEvents() & EPOLLIN)
+            conn->handleRead();
+    });
+}
+
+void TcpConnection::handleWrite() {
+    if (state == kDisconnected || !isWriting())
+        return;
+    // 边缘触发下要一直写到EAGAIN或写完，否则不会再收到EPOLLOUT
+    do {
+        ssize_t n = ::send(fd, output_buffer.peek(),
+                           output_buffer.readableBytes(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            LOG_ERROR("send error on fd {}: {}", fd, strerror(errno));
+            handleClose();
+            return;
+        }
+        output_buffer.retrieve(n);
+    } while (edge_triggered && output_buffer.readableBytes() > 0);
+    size_t pending = output_buffer.readableBytes();
+    if (above_high_water && pending <= low_water_mark) {
+        above_high_water = false;
+        if (low_water_callback)
+            low_water_callback(shared_from_this(), pending);
+    }
+    if (pending == 0) {
+        updateEvents(channel->getEvents() & ~EPOLLOUT);
+        if (state == kDisconnecting)
+            shutdownInLoop();
+    }
+}
+
+void TcpConnection::handleError() {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    LOG_ERROR("Connection error on fd {}: {}", fd, strerror(err));
+    // 有EPOLLIN时由随后的handleRead读到0或错误再关闭
+    if (!(channel->getRevents() & EPOLLIN)) {
+        handleClose();
+    }
+}
+
+void TcpConnection::handleClose() {
+    if (state == kDisconnected)
+        return;
+    state = kDisconnected;
+    // 回调中Server会把连接从表中删掉，这里先持有一份防止提前析构
+    TcpConnectionPtr guard = shared_from_this();
+    if (close_callback)
+        close_callback(guard);
+}
+
+void TcpConnection::sendInLoop(const char *data, size_t len) {
+    if (state != kConnected) {
+        LOG_WARN("Connection {} is closed, give up sending", id);
+        return;
+    }
+    // 输出缓冲区为空时先直接写，大多数情况下一次就能写完
+    size_t written = 0;
+    if (!isWriting() && output_buffer.readableBytes() == 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n >= 0) {
+            written = n;
+        } else if (errno != EAGAIN && errno != EINTR) {
+            LOG_ERROR("send error on fd {}: {}", fd, strerror(errno));
+            handleClose();
+            return;
+        }
+    }
+    if (written == len)
+        return;
+
+    // 剩下的放进输出缓冲区，等EPOLLOUT再发
+    output_buffer.append(data + written, len - written);
+    size_t pending = output_buffer.readableBytes();
+    if (high_water_mark > 0 && !above_high_water &&
+        pending >= high_water_mark) {
+        above_high_water = true;
+        if (high_water_callback)
+            high_water_callback(shared_from_this(), pending);
+    }
+    if (!isWriting())
+        updateEvents(channel->getEvents() | EPOLLOUT);
+}
+
+void TcpConnection::shutdownInLoop() {
+    if (state == kConnected)
+        state = kDisconnecting;
+    if (state != kDisconnecting)
+        return;
+    // 还有数据没发完时由handleWrite发完后再调用
+    if (!isWriting())
+        ::shutdown(fd, SHUT_WR);
+}
+
+void TcpConnection::updateEvents(uint32_t events) {
+    channel->setEvents(events);
+    loop->update(*channel);
+}
+
+bool TcpConnection::isWriting() const {
+    return channel->getEvents() & EPOLLOUT;
+}
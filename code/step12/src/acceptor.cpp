@@ -0,0 +1,161 @@
+#include "acceptor.h"
+#include "log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const size_t Acceptor::kDefaultMaxBatch;
+
+Acceptor::Acceptor(EpollManager *loop, int listen_fd)
+    : loop(loop), listen_fd(listen_fd),
+      idle_fd(open("/dev/null", O_RDONLY | O_CLOEXEC)),
+      max_batch(kDefaultMaxBatch), accept_flags(SOCK_NONBLOCK | SOCK_CLOEXEC),
+      edge_triggered(false), read_requeued(false), metrics_interval_ms(0),
+      metrics_scheduled(false), channel(std::make_shared<Channel>(listen_fd)) {
+    memset(&metrics, 0, sizeof(metrics));
+    memset(&last_report, 0, sizeof(last_report));
+    if (idle_fd < 0) {
+        LOG_ERROR("open /dev/null for spare fd failed: {}", strerror(errno));
+    }
+}
+
+Acceptor::~Acceptor() {
+    if (idle_fd >= 0)
+        close(idle_fd);
+}
+
+void Acceptor::setNewConnectionCallback(NewConnectionCallback cb) {
+    new_connection_callback = std::move(cb);
+}
+
+void Acceptor::setMaxBatch(size_t max_batch) {
+    this->max_batch = std::max<size_t>(max_batch, 1);
+}
+
+void Acceptor::setAcceptFlags(int flags) { accept_flags = flags; }
+
+void Acceptor::setEdgeTriggered(bool enable) { edge_triggered = enable; }
+
+void Acceptor::setMetricsInterval(int interval_ms) {
+    metrics_interval_ms = interval_ms;
+}
+
+void Acceptor::start() {
+    // 监听socket必须是非阻塞的，accept循环才能在EAGAIN时停下来
+    int flags = fcntl(listen_fd, F_GETFL, 0);
+    fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK);
+
+    // Acceptor和Server同生命期，回调里直接用this
+    channel->setEvents(edge_triggered ? EPOLLIN | EPOLLET : EPOLLIN);
+    channel->setReadCallback([this]() { this->handleRead(); });
+    loop->add(channel);
+}
+
+const Acceptor::Metrics &Acceptor::getMetrics() const { return metrics; }
+
+void Acceptor::handleRead() {
+    ++metrics.wakeups;
+    size_t batch = 0;
+    while (batch < max_batch) {
+        struct sockaddr_in peer;
+        socklen_t addrlen = sizeof(peer);
+        int fd = accept4(listen_fd, (struct sockaddr *)&peer, &addrlen,
+                         accept_flags);
+        if (fd >= 0) {
+            ++batch;
+            ++metrics.accepted;
+            if (new_connection_callback) {
+                new_connection_callback(fd, peer);
+            } else {
+                close(fd);
+            }
+            continue;
+        }
+
+        if (errno == EAGAIN) {
+            break;
+        } else if (errno == EINTR || errno == ECONNABORTED) {
+            // 对端在accept之前就断开了，继续接收下一个
+            continue;
+        } else if (errno == EMFILE || errno == ENFILE) {
+            if (!shedConnection())
+                break;
+            ++batch;
+        } else {
+            ++metrics.errors;
+            LOG_ERROR("accept failed: {}", strerror(errno));
+            break;
+        }
+    }
+
+    metrics.max_batch = std::max<uint64_t>(metrics.max_batch, batch);
+    if (batch > 0)
+        scheduleMetrics();
+    if (batch < max_batch)
+        return;
+
+    // 达到上限时可能还有连接在排队。LT模式下次epoll_wait会再次通知；
+    // ET模式不会，要在本轮事件之后自己接着接收
+    ++metrics.capped;
+    if (edge_triggered && !read_requeued) {
+        read_requeued = true;
+        loop->queueInLoop([this]() {
+            read_requeued = false;
+            handleRead();
+        });
+    }
+}
+
+bool Acceptor::shedConnection() {
+    if (idle_fd < 0) {
+        ++metrics.errors;
+        LOG_ERROR("accept failed: {}, no spare fd", strerror(errno));
+        return false;
+    }
+    // 让出备用fd，接下一个连接后马上关闭，对端会看到连接被关闭而不是
+    // 一直卡在监听队列里；然后重新占住备用fd
+    close(idle_fd);
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd >= 0) {
+        close(fd);
+        ++metrics.emfile_shed;
+    }
+    idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    LOG_WARN("accept failed: too many open files, connection dropped");
+    return fd >= 0;
+}
+
+// 速率只通过INFO日志输出，编译期去掉INFO日志时不启动定时器
+void Acceptor::scheduleMetrics() {
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
+    if (metrics_interval_ms <= 0 || metrics_scheduled)
+        return;
+    metrics_scheduled = true;
+    loop->runAfter(metrics_interval_ms, [this]() { this->reportMetrics(); });
+#endif
+}
+
+void Acceptor::reportMetrics() {
+    metrics_scheduled = false;
+    uint64_t accepted = metrics.accepted - last_report.accepted;
+    uint64_t shed = metrics.emfile_shed - last_report.emfile_shed;
+    // 这段时间没有新连接：不输出，也不再续定时器，空闲时时间轮不用转
+    if (accepted == 0 && shed == 0) {
+        last_report = metrics;
+        return;
+    }
+    LOG_INFO("Acceptor fd {}: {:.0f} conn/s, {:.1f} conn/wakeup, "
+             "capped {}, shed {}, errors {}, total {}",
+             listen_fd, accepted * 1000.0 / metrics_interval_ms,
+             metrics.wakeups > last_report.wakeups
+                 ? static_cast<double>(accepted) /
+                       (metrics.wakeups - last_report.wakeups)
+                 : 0.0,
+             metrics.capped - last_report.capped, shed,
+             metrics.errors - last_report.errors, metrics.accepted);
+    last_report = metrics;
+    scheduleMetrics();
+}
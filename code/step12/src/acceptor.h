@@ -0,0 +1,73 @@
+#ifndef ACCEPTOR_H
+#define ACCEPTOR_H
+
+#include "channel.h"
+#include "epollManager.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <netinet/in.h>
+
+// 监听socket的读事件处理：每次事件用accept4循环接收到EAGAIN，
+// 单次最多接收max_batch个，避免建连风暴时一直占着事件循环。
+// 预留一个备用fd，进程fd耗尽(EMFILE)时借它把排队的连接接下来立即关掉，
+// 否则LT模式下监听socket会一直可读，事件循环空转。
+// 只能在所属EpollManager线程中使用。
+class Acceptor {
+  public:
+    using NewConnectionCallback =
+        std::function<void(int fd, const struct sockaddr_in &peer)>;
+
+    // 计数都从start开始累计
+    struct Metrics {
+        uint64_t accepted;     // 成功接收的连接数
+        uint64_t wakeups;      // 处理读事件的次数
+        uint64_t capped;       // 达到max_batch提前返回的次数
+        uint64_t max_batch;    // 单次事件接收到的最多连接数
+        uint64_t emfile_shed;  // fd耗尽时接下来立即关闭的连接数
+        uint64_t errors;       // 其他accept错误
+    };
+
+    static const size_t kDefaultMaxBatch = 128;
+
+    // listen_fd由调用方创建、listen和关闭
+    Acceptor(EpollManager *loop, int listen_fd);
+    ~Acceptor();
+
+    void setNewConnectionCallback(NewConnectionCallback cb);
+    void setMaxBatch(size_t max_batch);
+    // 传给accept4的flags，默认SOCK_NONBLOCK | SOCK_CLOEXEC
+    void setAcceptFlags(int flags);
+    // 以EPOLLET注册监听socket。批次被截断时要自己安排下一轮继续接收
+    void setEdgeTriggered(bool enable);
+    // 每隔interval_ms输出一次这段时间的建连速率，0表示不输出。
+    // 定时器只在有新连接时运行，一段时间没有连接就停下，下个连接再启动
+    void setMetricsInterval(int interval_ms);
+
+    // 注册监听socket的Channel，以上设置需在start之前完成
+    void start();
+    const Metrics &getMetrics() const;
+
+  private:
+    void handleRead();
+    // fd耗尽时用备用fd接下一个连接并立即关闭，返回是否接到了连接
+    bool shedConnection();
+    void scheduleMetrics();
+    void reportMetrics();
+
+    EpollManager *loop;
+    int listen_fd;
+    int idle_fd; // 备用fd，平时打开/dev/null占住一个位置
+    size_t max_batch;
+    int accept_flags;
+    bool edge_triggered;
+    bool read_requeued; // ET模式下批次被截断后已经投递了继续接收的任务
+    int metrics_interval_ms;
+    bool metrics_scheduled; // 时间轮里有reportMetrics的定时器
+    std::shared_ptr<Channel> channel;
+    NewConnectionCallback new_connection_callback;
+    Metrics metrics;
+    Metrics last_report; // 上一次输出时的计数，用于计算区间速率
+};
+
+#endif // ACCEPTOR_H
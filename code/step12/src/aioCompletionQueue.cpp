@@ -0,0 +1,157 @@
+#include "aioCompletionQueue.h"
+#include "epollManager.h"
+#include "log.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// 信号处理函数中不能加锁，必须保证原子操作是无锁的
+static_assert(ATOMIC_BOOL_LOCK_FREE == 2,
+              "AioCompletionQueue requires lock-free atomic bool");
+
+#define AIO_COMPLETION_SIGNAL SIGRTMIN
+// 有在途请求时多久扫描一次，收回信号丢失的完成事件
+#define AIO_SWEEP_INTERVAL_MS 1000
+
+AioCompletionQueue::AioCompletionQueue(EpollManager &epoll_manager,
+                                       CompletionCallback cb)
+    : epoll_manager(epoll_manager), callback(std::move(cb)),
+      wakeup_pending(false), in_flight(nullptr), sweep_scheduled(false),
+      sweep_timer(0) {
+    installSignalHandler();
+
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd == -1) {
+        LOG_ERROR("Failed to create eventfd: {}", strerror(errno));
+        throw std::runtime_error("eventfd failed");
+    }
+    channel = std::make_shared<Channel>(event_fd);
+    channel->setEvents(EPOLLIN);
+    channel->setReadCallback([this]() { this->drain(); });
+    epoll_manager.add(channel);
+}
+
+AioCompletionQueue::~AioCompletionQueue() {
+    if (sweep_scheduled)
+        epoll_manager.cancelTimer(sweep_timer);
+    epoll_manager.remove(*channel);
+    close(event_fd);
+}
+
+void AioCompletionQueue::installSignalHandler() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = &AioCompletionQueue::handleSignal;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(AIO_COMPLETION_SIGNAL, &sa, nullptr) == -1) {
+            LOG_ERROR("sigaction failed: {}", strerror(errno));
+            throw std::runtime_error("sigaction failed");
+        }
+    });
+}
+
+int AioCompletionQueue::submit(AioRequest *req) {
+    req->cb.aio_sigevent.sigev_notify = SIGEV_SIGNAL;
+    req->cb.aio_sigevent.sigev_signo = AIO_COMPLETION_SIGNAL;
+    req->cb.aio_sigevent.sigev_value.sival_ptr = this;
+    int ret = req->op == AioRequest::kRead ? aio_read(&req->cb)
+                                           : aio_write(&req->cb);
+    if (ret == -1)
+        return -1;
+
+    req->prev = nullptr;
+    req->next = in_flight;
+    if (in_flight)
+        in_flight->prev = req;
+    in_flight = req;
+    scheduleSweep();
+    return 0;
+}
+
+// 信号里只带着队列指针，不访问请求本身：
+// 请求可能已经被扫描收回、重新提交甚至释放
+void AioCompletionQueue::handleSignal(int, siginfo_t *info, void *) {
+    AioCompletionQueue *queue =
+        static_cast<AioCompletionQueue *>(info->si_value.sival_ptr);
+    if (info->si_code != SI_ASYNCIO || queue == nullptr)
+        return;
+    int saved_errno = errno;
+    queue->wakeup();
+    errno = saved_errno;
+}
+
+void AioCompletionQueue::wakeup() {
+    // drain之前的多次完成只写一次eventfd
+    if (wakeup_pending.exchange(true))
+        return;
+    uint64_t one = 1;
+    ssize_t n = ::write(event_fd, &one, sizeof(one));
+    (void)n;
+}
+
+void AioCompletionQueue::drain() {
+    uint64_t count = 0;
+    ssize_t n = ::read(event_fd, &count, sizeof(count));
+    (void)n;
+    // 先清标记再扫描，扫描期间完成的请求会再唤醒一次
+    wakeup_pending.store(false);
+    collect();
+}
+
+size_t AioCompletionQueue::collect() {
+    // 先把完成的请求全部摘下来再回调，回调里会提交新的请求
+    AioRequest *done = nullptr;
+    AioRequest *req = in_flight;
+    while (req) {
+        AioRequest *next = req->next;
+        if (aio_error(&req->cb) != EINPROGRESS) {
+            unlink(req);
+            req->next = done;
+            done = req;
+        }
+        req = next;
+    }
+    size_t count = 0;
+    while (done) {
+        AioRequest *next = done->next;
+        callback(done);
+        done = next;
+        ++count;
+    }
+    return count;
+}
+
+void AioCompletionQueue::unlink(AioRequest *req) {
+    if (req->prev)
+        req->prev->next = req->next;
+    else
+        in_flight = req->next;
+    if (req->next)
+        req->next->prev = req->prev;
+}
+
+// 只在有在途请求时运行，全部完成后停下，下次提交再启动
+void AioCompletionQueue::scheduleSweep() {
+    if (sweep_scheduled)
+        return;
+    sweep_scheduled = true;
+    sweep_timer = epoll_manager.runAfter(AIO_SWEEP_INTERVAL_MS,
+                                         [this]() { this->sweep(); });
+}
+
+void AioCompletionQueue::sweep() {
+    sweep_scheduled = false;
+    size_t count = collect();
+    // 信号可能只是还没送到，不一定丢了，只在debug级别输出
+    if (count > 0)
+        LOG_DEBUG("sweep collected {} AIO completions", count);
+    if (in_flight)
+        scheduleSweep();
+}
@@ -0,0 +1,67 @@
+#ifndef AIOCOMPLETIONQUEUE_H
+#define AIOCOMPLETIONQUEUE_H
+
+#include "channel.h"
+#include "timerWheel.h"
+#include <aio.h>
+#include <atomic>
+#include <csignal>
+#include <functional>
+#include <memory>
+
+class AioCompletionQueue;
+class EpollManager;
+
+// 一次POSIX AIO请求，提交后挂在完成队列的在途链表上，完成后摘下来回调
+struct AioRequest {
+    enum Op { kRead, kWrite };
+
+    struct aiocb cb;
+    Op op;
+    int fd;
+    AioRequest *prev; // 在途链表的侵入式指针
+    AioRequest *next;
+    char *buffer; // 读写缓冲区
+};
+
+// AIO完成事件队列。完成通知使用实时信号(SIGEV_SIGNAL)，但信号只用来
+// 唤醒：实时信号队列满(RLIMIT_SIGPENDING)时glibc的sigqueue失败了也不
+// 处理，信号会丢。所以信号处理函数只写eventfd，所属EpollManager被唤醒后
+// 在自己的线程里扫描在途链表，aio_error不再是EINPROGRESS的就是完成了；
+// 另外有在途请求时定时扫描一次，信号丢了也能收回完成事件。
+// 每次扫描的开销和在途请求数成正比，同一轮的多个完成只扫描一次。
+class AioCompletionQueue {
+  public:
+    using CompletionCallback = std::function<void(AioRequest *req)>;
+
+    AioCompletionQueue(EpollManager &epoll_manager, CompletionCallback cb);
+    ~AioCompletionQueue();
+
+    // 按req->op调用aio_read/aio_write并跟踪这个请求，完成时回调。
+    // 提交失败返回-1并设置errno，请求不会被跟踪
+    int submit(AioRequest *req);
+
+  private:
+    static void handleSignal(int signo, siginfo_t *info, void *context);
+    static void installSignalHandler();
+
+    // 可在信号处理函数中调用：只有一次原子交换和一次write
+    void wakeup();
+    void drain();
+    // 摘下所有已完成的请求并回调，返回回调的个数
+    size_t collect();
+    void scheduleSweep();
+    void sweep();
+    void unlink(AioRequest *req);
+
+    EpollManager &epoll_manager;
+    CompletionCallback callback;
+    int event_fd;
+    std::shared_ptr<Channel> channel;
+    std::atomic<bool> wakeup_pending; // 已经写过eventfd，还没有drain
+    AioRequest *in_flight;            // 在途链表，只在所属线程访问
+    bool sweep_scheduled;
+    TimerId sweep_timer;
+};
+
+#endif // AIOCOMPLETIONQUEUE_H
@@ -0,0 +1,210 @@
+#include "aioCompletionQueue.h"
+#include "epollManager.h"
+#include "memoryPool.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 统计进程内所有malloc/operator new的调用次数（包括glibc AIO的辅助线程）
+static std::atomic<long> malloc_calls(0);
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size) {
+    malloc_calls.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+    malloc_calls.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    malloc_calls.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void *operator new(size_t size) {
+    void *p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+#define RESPONSE_PREFIX "server: "
+#define RESPONSE_PREFIX_LEN (sizeof(RESPONSE_PREFIX) - 1)
+
+// AIO读写路径的分配次数测试：在socketpair上重复 aio_read -> aio_write，
+// 完成事件经AioCompletionQueue回到EpollManager，与step12_server的AIO
+// 模式相同。分别用new/malloc/strdup和MemoryPool分配控制块与缓冲区，
+// 预热后统计每个请求的malloc次数，池化后稳态应为0。
+class AllocBench {
+  public:
+    AllocBench(int buffer_size, int requests);
+    ~AllocBench();
+    void run();
+
+  private:
+    // 返回测量阶段的malloc总次数
+    long run_mode(bool pooled);
+    void round_trip(bool pooled);
+    void wait_completion();
+
+    int buffer_size;
+    int requests;
+    int fds[2]; // fds[0]相当于服务端连接，fds[1]是客户端
+    EpollManager epoll_manager;
+    AioCompletionQueue aio_queue;
+    MemoryPool request_pool;
+    MemoryPool buffer_pool;
+    AioRequest *completed;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+AllocBench::AllocBench(int buffer_size, int requests)
+    : buffer_size(buffer_size), requests(requests), epoll_manager(10),
+      aio_queue(epoll_manager,
+                [this](AioRequest *req) { this->completed = req; }),
+      request_pool(sizeof(AioRequest)),
+      buffer_pool(RESPONSE_PREFIX_LEN + buffer_size), completed(nullptr) {
+    logger = spdlog::stdout_color_mt("alloc_bench");
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        logger->error("socketpair failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+AllocBench::~AllocBench() {
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void AllocBench::wait_completion() {
+    completed = nullptr;
+    while (completed == nullptr) {
+        epoll_manager.wait(-1);
+    }
+}
+
+void AllocBench::round_trip(bool pooled) {
+    const char msg[] = "hello";
+    if (write(fds[1], msg, sizeof(msg) - 1) != sizeof(msg) - 1) {
+        logger->error("write failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // 与改造前的服务端一致：每个请求new控制块、malloc读缓冲区、
+    // strdup响应；池化版本从MemoryPool取，并复用同一个缓冲区写回
+    AioRequest *req;
+    if (pooled) {
+        req = static_cast<AioRequest *>(request_pool.allocate());
+        memset(req, 0, sizeof(AioRequest));
+        req->buffer = static_cast<char *>(buffer_pool.allocate());
+        memcpy(req->buffer, RESPONSE_PREFIX, RESPONSE_PREFIX_LEN);
+    } else {
+        req = new AioRequest;
+        memset(req, 0, sizeof(AioRequest));
+        req->buffer = static_cast<char *>(malloc(buffer_size));
+    }
+    req->fd = fds[0];
+
+    memset(&req->cb, 0, sizeof(struct aiocb));
+    req->cb.aio_fildes = req->fd;
+    req->cb.aio_buf = pooled ? req->buffer + RESPONSE_PREFIX_LEN : req->buffer;
+    req->cb.aio_nbytes = buffer_size;
+    req->op = AioRequest::kRead;
+    if (aio_queue.submit(req) == -1) {
+        logger->error("aio_read failed");
+        exit(EXIT_FAILURE);
+    }
+    wait_completion();
+    int n = aio_return(&req->cb);
+
+    char *response;
+    size_t len;
+    if (pooled) {
+        response = req->buffer;
+        len = RESPONSE_PREFIX_LEN + n;
+    } else {
+        std::string str = RESPONSE_PREFIX + std::string(req->buffer, n);
+        response = strdup(str.c_str());
+        len = str.length();
+    }
+    memset(&req->cb, 0, sizeof(struct aiocb));
+    req->cb.aio_fildes = req->fd;
+    req->cb.aio_buf = response;
+    req->cb.aio_nbytes = len;
+    req->op = AioRequest::kWrite;
+    if (aio_queue.submit(req) == -1) {
+        logger->error("aio_write failed");
+        exit(EXIT_FAILURE);
+    }
+    wait_completion();
+    aio_return(&req->cb);
+
+    char reply[64];
+    if (read(fds[1], reply, sizeof(reply)) != static_cast<ssize_t>(len)) {
+        logger->error("short reply");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pooled) {
+        buffer_pool.deallocate(req->buffer);
+        request_pool.deallocate(req);
+    } else {
+        free(response);
+        free(req->buffer);
+        delete req;
+    }
+}
+
+long AllocBench::run_mode(bool pooled) {
+    // 预热：让线程缓存、slab和glibc AIO内部的请求表都达到稳态
+    for (int i = 0; i < 1000; ++i) {
+        round_trip(pooled);
+    }
+    long before = malloc_calls.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; ++i) {
+        round_trip(pooled);
+    }
+    auto end = std::chrono::steady_clock::now();
+    long calls = malloc_calls.load() - before;
+    double us = std::chrono::duration<double, std::micro>(end - start).count();
+    logger->info("{:6}: {} requests, {} malloc calls ({:.3f}/request), "
+                 "{:.2f} us/request",
+                 pooled ? "pool" : "malloc", requests, calls,
+                 static_cast<double>(calls) / requests, us / requests);
+    return calls;
+}
+
+void AllocBench::run() {
+    run_mode(false);
+    long pooled_calls = run_mode(true);
+    if (pooled_calls != 0) {
+        logger->error("pooled path still calls malloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // 只看分配次数，关掉Channel等模块的逐事件日志
+    spdlog::set_level(spdlog::level::warn);
+    int requests = argc > 1 ? atoi(argv[1]) : 100000;
+
+    AllocBench bench(1024, requests);
+    spdlog::get("alloc_bench")->set_level(spdlog::level::info);
+    bench.run();
+    return 0;
+}
@@ -0,0 +1,327 @@
+#include "asyncLogSink.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <spdlog/pattern_formatter.h>
+#include <unistd.h>
+
+// 缓冲区中每条记录的头部，后面依次是logger名和消息正文，整条按8字节对齐。
+// 剩余空间放不下一条记录时，用padding记录把尾部空间占掉，从头开始写；
+// 尾部连头部都放不下时不写padding，消费者同样直接跳到开头。
+struct RecordHeader {
+    uint32_t size;        // 整条记录占用的字节数，含头部和对齐
+    uint32_t payload_len; // 消息正文长度
+    int64_t time_ns;      // system_clock的纳秒时间戳
+    uint64_t thread_id;
+    uint8_t level;
+    uint8_t name_len;
+    uint8_t padding; // 非0表示这是占位记录
+};
+
+static const size_t kRecordAlign = 8;
+// 攒够这么多字节先write一次，避免格式化缓冲区无限增长
+static const size_t kWriteBatchBytes = 64 * 1024;
+
+static size_t alignRecord(size_t size) {
+    return (size + kRecordAlign - 1) / kRecordAlign * kRecordAlign;
+}
+
+// 只有一个线程修改的计数，不需要原子的读-改-写
+static void increment(std::atomic<uint64_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+}
+
+static size_t roundUpPowerOfTwo(size_t n) {
+    size_t size = 4096;
+    while (size < n)
+        size <<= 1;
+    return size;
+}
+
+// 单生产者单消费者的字节环形缓冲区。head和tail只增不减，
+// 取模后才是下标；两者分开放在不同的cache line上。
+struct AsyncLogSink::Ring {
+    explicit Ring(size_t capacity)
+        : data(new char[capacity]), capacity(capacity), head(0),
+          tail(0), cached_head(0), dropped(0), blocked(0), truncated(0) {}
+
+    std::unique_ptr<char[]> data;
+    const size_t capacity;
+
+    char pad0[64];
+    std::atomic<uint64_t> head; // 消费者写，生产者读
+    char pad1[64];
+    std::atomic<uint64_t> tail; // 生产者写，消费者读
+    uint64_t cached_head;       // 生产者上次读到的head，空间不够时才重新读
+    // 以下计数只由生产者修改，getMetrics在其他线程读取
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> blocked;
+    std::atomic<uint64_t> truncated;
+    char pad2[64];
+};
+
+const size_t AsyncLogSink::kDefaultRingBytes;
+const int AsyncLogSink::kIdleSleepMs;
+
+static std::atomic<size_t> next_sink_id(0);
+
+thread_local std::vector<AsyncLogSink::Ring *> AsyncLogSink::thread_rings;
+
+AsyncLogSink::AsyncLogSink(const std::string &filename, OverflowPolicy policy,
+                           size_t ring_bytes)
+    : id(next_sink_id.fetch_add(1)), policy(policy),
+      ring_bytes(roundUpPowerOfTwo(ring_bytes)),
+      formatter(new spdlog::pattern_formatter()), reported_dropped(0),
+      wake_requested(false), written(0), running(true) {
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                0644);
+    if (fd < 0) {
+        spdlog::throw_spdlog_ex("Failed to open log file " + filename, errno);
+    }
+    flusher = std::thread([this]() { flusherLoop(); });
+}
+
+AsyncLogSink::~AsyncLogSink() {
+    running.store(false);
+    wakeFlusher();
+    flusher.join();
+
+    Metrics metrics = getMetrics();
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    appendNotice(spdlog::level::info,
+                 "async log closed: " + std::to_string(metrics.written) +
+                     " written, " + std::to_string(metrics.dropped) +
+                     " dropped, " + std::to_string(metrics.blocked) +
+                     " blocked, " + std::to_string(metrics.truncated) +
+                     " truncated");
+    writeOut();
+    ::close(fd);
+}
+
+AsyncLogSink::Ring &AsyncLogSink::localRing() {
+    if (id < thread_rings.size() && thread_rings[id] != nullptr) {
+        return *thread_rings[id];
+    }
+    return registerThread();
+}
+
+AsyncLogSink::Ring &AsyncLogSink::registerThread() {
+    Ring *ring = new Ring(ring_bytes);
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(std::unique_ptr<Ring>(ring));
+    }
+    if (thread_rings.size() <= id) {
+        thread_rings.resize(id + 1, nullptr);
+    }
+    thread_rings[id] = ring;
+    return *ring;
+}
+
+void AsyncLogSink::log(const spdlog::details::log_msg &msg) {
+    Ring &ring = localRing();
+
+    size_t name_len = std::min<size_t>(msg.logger_name.size(), 255);
+    size_t payload_len = msg.payload.size();
+    const size_t max_record = ring.capacity / 4;
+    if (sizeof(RecordHeader) + name_len + payload_len > max_record) {
+        payload_len = max_record - sizeof(RecordHeader) - name_len;
+        increment(ring.truncated);
+    }
+    const size_t size =
+        alignRecord(sizeof(RecordHeader) + name_len + payload_len);
+
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    size_t offset = tail & (ring.capacity - 1);
+    // 尾部放不下就连同尾部剩余空间一起申请，记录从缓冲区开头写
+    size_t skip = offset + size > ring.capacity ? ring.capacity - offset : 0;
+    size_t need = skip + size;
+
+    if (ring.capacity - (tail - ring.cached_head) < need) {
+        ring.cached_head = ring.head.load(std::memory_order_acquire);
+        if (ring.capacity - (tail - ring.cached_head) < need) {
+            if (policy == OverflowPolicy::kDrop) {
+                increment(ring.dropped);
+                return;
+            }
+            increment(ring.blocked);
+            wakeFlusher();
+            while (ring.capacity - (tail - ring.cached_head) < need) {
+                std::this_thread::yield();
+                ring.cached_head = ring.head.load(std::memory_order_acquire);
+            }
+        }
+    }
+
+    char *base = ring.data.get();
+    if (skip > 0) {
+        if (skip >= sizeof(RecordHeader)) {
+            RecordHeader *pad = reinterpret_cast<RecordHeader *>(base + offset);
+            pad->size = static_cast<uint32_t>(skip);
+            pad->padding = 1;
+        }
+        offset = 0;
+    }
+
+    RecordHeader *header = reinterpret_cast<RecordHeader *>(base + offset);
+    header->size = static_cast<uint32_t>(size);
+    header->payload_len = static_cast<uint32_t>(payload_len);
+    header->time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          msg.time.time_since_epoch())
+                          .count();
+    header->thread_id = msg.thread_id;
+    header->level = static_cast<uint8_t>(msg.level);
+    header->name_len = static_cast<uint8_t>(name_len);
+    header->padding = 0;
+    char *body = base + offset + sizeof(RecordHeader);
+    memcpy(body, msg.logger_name.data(), name_len);
+    memcpy(body + name_len, msg.payload.data(), payload_len);
+
+    ring.tail.store(tail + need, std::memory_order_release);
+}
+
+size_t AsyncLogSink::drain() {
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        drain_rings.clear();
+        for (const std::unique_ptr<Ring> &ring : rings) {
+            drain_rings.push_back(ring.get());
+        }
+    }
+
+    size_t count = 0;
+    uint64_t dropped = 0;
+    for (Ring *ring : drain_rings) {
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+        const char *base = ring->data.get();
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        const uint64_t tail = ring->tail.load(std::memory_order_acquire);
+        while (head < tail) {
+            size_t offset = head & (ring->capacity - 1);
+            size_t remain = ring->capacity - offset;
+            if (remain < sizeof(RecordHeader)) {
+                head += remain;
+                continue;
+            }
+            const RecordHeader *header =
+                reinterpret_cast<const RecordHeader *>(base + offset);
+            if (header->padding) {
+                head += header->size;
+                continue;
+            }
+
+            const char *body = base + offset + sizeof(RecordHeader);
+            spdlog::details::log_msg msg(
+                spdlog::log_clock::time_point(
+                    std::chrono::duration_cast<spdlog::log_clock::duration>(
+                        std::chrono::nanoseconds(header->time_ns))),
+                spdlog::source_loc(),
+                spdlog::string_view_t(body, header->name_len),
+                static_cast<spdlog::level::level_enum>(header->level),
+                spdlog::string_view_t(body + header->name_len,
+                                      header->payload_len));
+            msg.thread_id = header->thread_id;
+            formatter->format(msg, out);
+            ++count;
+
+            // 格式化结果已经拷出，这条记录的空间可以还给生产者
+            head += header->size;
+            ring->head.store(head, std::memory_order_release);
+            if (out.size() >= kWriteBatchBytes) {
+                writeOut();
+            }
+        }
+        ring->head.store(head, std::memory_order_release);
+    }
+
+    if (dropped > reported_dropped) {
+        appendNotice(spdlog::level::warn,
+                     "async log buffer full, dropped " +
+                         std::to_string(dropped - reported_dropped) +
+                         " records");
+        reported_dropped = dropped;
+    }
+    writeOut();
+    written.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+void AsyncLogSink::appendNotice(spdlog::level::level_enum level,
+                                const std::string &text) {
+    spdlog::details::log_msg msg(spdlog::string_view_t("async_log"), level,
+                                 spdlog::string_view_t(text));
+    formatter->format(msg, out);
+}
+
+void AsyncLogSink::writeOut() {
+    const char *data = out.data();
+    size_t left = out.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, data, left);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            // 写文件失败时没有别的地方可以报告，丢掉这一批
+            break;
+        }
+        data += n;
+        left -= n;
+    }
+    out.clear();
+}
+
+void AsyncLogSink::wakeFlusher() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake_requested = true;
+    }
+    wake_cond.notify_one();
+}
+
+void AsyncLogSink::flusherLoop() {
+    while (running.load()) {
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(drain_mutex);
+            count = drain();
+        }
+        if (count == 0) {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake_cond.wait_for(lock, std::chrono::milliseconds(kIdleSleepMs),
+                               [this]() { return wake_requested; });
+            wake_requested = false;
+        }
+    }
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    drain();
+}
+
+void AsyncLogSink::flush() {
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    drain();
+}
+
+void AsyncLogSink::set_pattern(const std::string &pattern) {
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    formatter.reset(new spdlog::pattern_formatter(pattern));
+}
+
+void AsyncLogSink::set_formatter(
+    std::unique_ptr<spdlog::formatter> sink_formatter) {
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    formatter = std::move(sink_formatter);
+}
+
+AsyncLogSink::Metrics AsyncLogSink::getMetrics() {
+    Metrics metrics = {written.load(), 0, 0, 0};
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (const std::unique_ptr<Ring> &ring : rings) {
+        metrics.dropped += ring->dropped.load(std::memory_order_relaxed);
+        metrics.blocked += ring->blocked.load(std::memory_order_relaxed);
+        metrics.truncated += ring->truncated.load(std::memory_order_relaxed);
+    }
+    return metrics;
+}
@@ -0,0 +1,208 @@
+#ifndef BINARYLOG_H
+#define BINARYLOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <spdlog/common.h>
+#include <string>
+#include <type_traits>
+
+// 二进制日志：调用处不格式化字符串，只把格式id、时间戳和原始参数写进
+// mmap的日志文件，由离线工具log_decode按格式还原成文本。
+// 格式串在每个调用处第一次执行时登记一次，登记记录和普通记录写在同一个文件里。
+// 文件被切成定长的chunk，每个线程独占一个chunk顺序追加，
+// 写满再原子地领一个新的。写日志的路径上没有锁、没有系统调用，
+// 也不需要后台线程；进程被杀掉后已经写进映射区的记录仍由内核写回文件。
+// 文件写满后新的记录丢弃并计数。
+//
+// 文件布局：kHeaderBytes的文件头，之后是chunk_count个chunk。
+// chunk开头8字节是线程id，之后是连续的记录，id为0表示这个chunk后面没有记录了。
+// 记录：uint16格式id，uint16记录总长，int64时间戳(system_clock纳秒)，参数。
+// 参数按类型编码：b=bool 1字节，i=int64，u=uint64，d=double，
+// s=uint16长度加字节(最多kMaxStringBytes，超出截断)。
+// 登记记录的id为kFormatRecordId，内容是uint16格式id、uint8级别、uint32行号，
+// 之后依次是以'\0'结尾的参数类型串、logger名、文件名和格式串。
+
+struct BinaryLogFileHeader {
+    char magic[8];
+    uint64_t chunk_bytes;
+    uint64_t chunk_count;
+    std::atomic<uint64_t> next_chunk; // 已经领走的chunk数
+    std::atomic<uint64_t> dropped;    // 文件写满后丢弃的记录数
+};
+
+class BinaryLog {
+  public:
+    static const char kMagic[8];
+    static const size_t kHeaderBytes = 4096;
+    static const size_t kChunkHeaderBytes = sizeof(uint64_t);
+    static const size_t kRecordHeaderBytes =
+        sizeof(uint16_t) * 2 + sizeof(int64_t);
+    static const uint16_t kFormatRecordId = 0xffff;
+    static const size_t kMaxStringBytes = 1024;
+    static const size_t kDefaultCapacity = 64 * 1024 * 1024;
+    static const size_t kDefaultChunkBytes = 1024 * 1024;
+
+    // 创建path并映射capacity字节，之后LOG_*宏改为写二进制记录。
+    // 映射时预先分配好页，写日志时不会再缺页。只能在写日志的线程启动前调用，
+    // 失败返回false，日志仍走spdlog
+    static bool open(const std::string &path,
+                     size_t capacity = kDefaultCapacity,
+                     size_t chunk_bytes = kDefaultChunkBytes);
+    // 所有线程都不再写日志之后才能调用
+    static void close();
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static uint64_t dropped();
+
+    // 登记调用处的格式，返回格式id。只用参数的类型，不读参数的值。
+    // id用完或者登记记录写不进文件时返回kFormatRecordId，这个调用处的
+    // 记录全部丢弃
+    template <typename... Args>
+    static uint16_t registerFormat(spdlog::level::level_enum level,
+                                   const std::string &logger_name,
+                                   const char *file, int line, const char *fmt,
+                                   const Args &...args);
+
+    template <typename... Args>
+    static void write(uint16_t id, const char *fmt, const Args &...args);
+
+  private:
+    enum class ArgKind { kBool, kSigned, kUnsigned, kDouble, kString };
+
+    template <typename T> struct ArgKindOf {
+        static const ArgKind value =
+            std::is_same<T, bool>::value ? ArgKind::kBool
+            : std::is_enum<T>::value     ? ArgKind::kSigned
+            : std::is_integral<T>::value
+                ? (std::is_signed<T>::value ? ArgKind::kSigned
+                                            : ArgKind::kUnsigned)
+            : std::is_floating_point<T>::value ? ArgKind::kDouble
+                                               : ArgKind::kString;
+    };
+
+    template <ArgKind K> using KindTag = std::integral_constant<ArgKind, K>;
+
+    // 在当前线程的chunk中预留size字节，chunk不够时领新的，文件写满返回nullptr
+    static char *reserve(size_t size);
+    static uint16_t registerFormatImpl(spdlog::level::level_enum level,
+                                       const std::string &logger_name,
+                                       const char *file, int line,
+                                       const char *fmt,
+                                       const std::string &types);
+    static int64_t now();
+
+    static void appendTypes(std::string &) {}
+    template <typename T, typename... Rest>
+    static void appendTypes(std::string &types, const T &,
+                            const Rest &...rest) {
+        static const char codes[] = {'b', 'i', 'u', 'd', 's'};
+        types.push_back(codes[static_cast<int>(
+            ArgKindOf<typename std::decay<T>::type>::value)]);
+        appendTypes(types, rest...);
+    }
+
+    static spdlog::string_view_t toString(const char *s) {
+        return spdlog::string_view_t(s, strlen(s));
+    }
+    static spdlog::string_view_t toString(const std::string &s) {
+        return spdlog::string_view_t(s.data(), s.size());
+    }
+    static spdlog::string_view_t toString(spdlog::string_view_t s) {
+        return s;
+    }
+
+    template <typename T>
+    static size_t argSize(const T &, KindTag<ArgKind::kBool>) {
+        return 1;
+    }
+    template <typename T, ArgKind K>
+    static size_t argSize(const T &, KindTag<K>) {
+        return 8;
+    }
+    template <typename T>
+    static size_t argSize(const T &arg, KindTag<ArgKind::kString>) {
+        size_t len = toString(arg).size();
+        return sizeof(uint16_t) +
+               (len < kMaxStringBytes ? len : kMaxStringBytes);
+    }
+
+    static size_t argsSize() { return 0; }
+    template <typename T, typename... Rest>
+    static size_t argsSize(const T &arg, const Rest &...rest) {
+        typedef typename std::decay<T>::type Arg;
+        return argSize(arg, KindTag<ArgKindOf<Arg>::value>()) +
+               argsSize(rest...);
+    }
+
+    template <typename T>
+    static char *putArg(char *p, const T &arg, KindTag<ArgKind::kBool>) {
+        *p = arg ? 1 : 0;
+        return p + 1;
+    }
+    template <typename T>
+    static char *putArg(char *p, const T &arg, KindTag<ArgKind::kSigned>) {
+        int64_t v = static_cast<int64_t>(arg);
+        memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+    }
+    template <typename T>
+    static char *putArg(char *p, const T &arg, KindTag<ArgKind::kUnsigned>) {
+        uint64_t v = static_cast<uint64_t>(arg);
+        memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+    }
+    template <typename T>
+    static char *putArg(char *p, const T &arg, KindTag<ArgKind::kDouble>) {
+        double v = static_cast<double>(arg);
+        memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+    }
+    template <typename T>
+    static char *putArg(char *p, const T &arg, KindTag<ArgKind::kString>) {
+        spdlog::string_view_t s = toString(arg);
+        uint16_t len = static_cast<uint16_t>(
+            s.size() < kMaxStringBytes ? s.size() : kMaxStringBytes);
+        memcpy(p, &len, sizeof(len));
+        memcpy(p + sizeof(len), s.data(), len);
+        return p + sizeof(len) + len;
+    }
+
+    static char *putArgs(char *p) { return p; }
+    template <typename T, typename... Rest>
+    static char *putArgs(char *p, const T &arg, const Rest &...rest) {
+        typedef typename std::decay<T>::type Arg;
+        p = putArg(p, arg, KindTag<ArgKindOf<Arg>::value>());
+        return putArgs(p, rest...);
+    }
+
+    static std::atomic<bool> enabled_;
+};
+
+template <typename... Args>
+uint16_t BinaryLog::registerFormat(spdlog::level::level_enum level,
+                                   const std::string &logger_name,
+                                   const char *file, int line, const char *fmt,
+                                   const Args &...args) {
+    std::string types;
+    appendTypes(types, args...);
+    return registerFormatImpl(level, logger_name, file, line, fmt, types);
+}
+
+template <typename... Args>
+void BinaryLog::write(uint16_t id, const char *, const Args &...args) {
+    if (id == kFormatRecordId)
+        return;
+    size_t size = kRecordHeaderBytes + argsSize(args...);
+    char *p = reserve(size);
+    if (p == nullptr)
+        return;
+    uint16_t record_size = static_cast<uint16_t>(size);
+    int64_t time_ns = now();
+    memcpy(p, &id, sizeof(id));
+    memcpy(p + sizeof(id), &record_size, sizeof(record_size));
+    memcpy(p + sizeof(id) * 2, &time_ns, sizeof(time_ns));
+    putArgs(p + kRecordHeaderBytes, args...);
+}
+
+#endif // BINARYLOG_H
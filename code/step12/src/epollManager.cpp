@@ -1,41 +1,207 @@
 #include "epollManager.h"
-#include <spdlog/spdlog.h>
+#include "epollPoller.h"
+#include "log.h"
+#include "uringPoller.h"
 #include <stdexcept>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
-EpollManager::EpollManager(int max_events)
-    : max_events(max_events), events(max_events) {
-    epoll_fd = epoll_create1(0);
-    if (epoll_fd == -1) {
-        spdlog::error("Failed to create epoll file descriptor: {}",
-                      strerror(errno));
-        throw std::runtime_error("epoll_create1 failed");
+EpollManager::EpollManager(int max_events, int timer_tick_ms,
+                           PollerType type)
+    : uring_poller(nullptr), thread_id(std::this_thread::get_id()),
+      timer_wheel(timer_tick_ms), calling_pending_functors(false) {
+    if (type == PollerType::kUring) {
+        // max_events只是epoll每轮返回的事件数，io_uring的队列和
+        // provided buffer用UringPoller自己的默认大小
+        uring_poller = new UringPoller(UringPoller::kDefaultEntries,
+                                       UringPoller::kDefaultBufferCount,
+                                       UringPoller::kDefaultBufferSize);
+        poller.reset(uring_poller);
+    } else {
+        poller.reset(new EpollPoller(max_events));
     }
+    active_events.reserve(max_events);
+
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd == -1) {
+        LOG_ERROR("Failed to create eventfd: {}", strerror(errno));
+        throw std::runtime_error("eventfd failed");
+    }
+    wakeup_channel = std::make_shared<Channel>(wakeup_fd);
+    wakeup_channel->setEvents(EPOLLIN);
+    wakeup_channel->setReadCallback([this]() { this->handleWakeup(); });
+    add(wakeup_channel);
+
+    timer_channel = std::make_shared<Channel>(timer_wheel.getFd());
+    timer_channel->setEvents(EPOLLIN);
+    timer_channel->setReadCallback([this]() { timer_wheel.handleRead(); });
+    add(timer_channel);
 }
 
-EpollManager::~EpollManager() { close(epoll_fd); }
+EpollManager::~EpollManager() { close(wakeup_fd); }
+
+void EpollManager::add(std::shared_ptr<Channel> channel) {
+    int fd = channel->getFd();
+    if (fd >= static_cast<int>(channels.size())) {
+        channels.resize(fd + 1, ChannelSlot{nullptr, 0, 0});
+    }
+    ChannelSlot &slot = channels[fd];
+    if (slot.channel) {
+        // fd已经被关闭并复用，但旧Channel没有remove，这里直接顶替
+        LOG_WARN("fd {} registered again without remove", fd);
+        timer_wheel.cancel(slot.idle_timer);
+        slot.idle_timer = 0;
+    }
+
+    poller->add(fd, channel->getEvents(),
+                (static_cast<uint64_t>(slot.generation + 1) << 32) |
+                    static_cast<uint32_t>(fd));
+    slot.generation++;
+    slot.channel = std::move(channel);
+}
+
+void EpollManager::update(Channel &channel) {
+    int fd = channel.getFd();
+    if (fd >= static_cast<int>(channels.size()) ||
+        channels[fd].channel.get() != &channel) {
+        LOG_ERROR("update on unregistered fd: {}", fd);
+        throw std::runtime_error("update on unregistered channel");
+    }
+
+    poller->modify(fd, channel.getEvents(),
+                   (static_cast<uint64_t>(channels[fd].generation) << 32) |
+                       static_cast<uint32_t>(fd));
+}
 
-void EpollManager::add(Channel &channel) {
-    struct epoll_event event;
-    event.events = channel.getEvents();
-    event.data.ptr = &channel;
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, channel.getFd(), &event) == -1) {
-        spdlog::error("Failed to add fd to epoll: {}, error: {}",
-                      channel.getFd(), strerror(errno));
-        throw std::runtime_error("epoll_ctl failed");
+void EpollManager::remove(Channel &channel) {
+    int fd = channel.getFd();
+    if (fd >= static_cast<int>(channels.size()) ||
+        channels[fd].channel.get() != &channel) {
+        LOG_WARN("remove on unregistered fd: {}", fd);
+        return;
+    }
+    poller->remove(fd);
+    if (channels[fd].idle_timer != 0) {
+        timer_wheel.cancel(channels[fd].idle_timer);
+        channels[fd].idle_timer = 0;
     }
+    // 释放所有权，正在处理事件的Channel由wait中的局部引用保证不被提前析构
+    channels[fd].channel.reset();
 }
 
 void EpollManager::wait(int timeout) {
-    int num_fds = epoll_wait(epoll_fd, events.data(), max_events, timeout);
-    if (num_fds == -1) {
-        spdlog::error("epoll_wait failed: {}", strerror(errno));
-        throw std::runtime_error("epoll_wait failed");
-    }
-    for (int i = 0; i < num_fds; i++) {
-        Channel *channel = static_cast<Channel *>(events[i].data.ptr);
-        channel->setRevents(events[i].events);
+    active_events.clear();
+    poller->poll(timeout, active_events);
+    for (const PollEvent &event : active_events) {
+        int fd = static_cast<int>(event.token & 0xffffffff);
+        uint32_t generation = static_cast<uint32_t>(event.token >> 32);
+        // 同一批事件中前面的回调可能已经remove了这个fd甚至复用了它
+        if (fd >= static_cast<int>(channels.size()) ||
+            channels[fd].generation != generation || !channels[fd].channel) {
+            LOG_DEBUG("Skip stale event for fd: {}", fd);
+            continue;
+        }
+        if (channels[fd].idle_timer != 0) {
+            timer_wheel.refresh(channels[fd].idle_timer);
+        }
+        std::shared_ptr<Channel> channel = channels[fd].channel;
+        channel->setRevents(event.events);
         channel->handleEvent();
     }
+    doPendingFunctors();
+}
+
+void EpollManager::loop() {
+    thread_id = std::this_thread::get_id();
+    // 每个EpollManager独占一个线程，没有事件时一直阻塞在epoll_wait上
+    while (true) {
+        wait(-1);
+    }
+}
+
+void EpollManager::runInLoop(Functor cb) {
+    if (isInLoopThread()) {
+        cb();
+    } else {
+        queueInLoop(std::move(cb));
+    }
+}
+
+void EpollManager::queueInLoop(Functor cb) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_functors.push_back(std::move(cb));
+    }
+    // 正在执行pending_functors时新加入的任务要等到下一轮，同样需要唤醒
+    if (!isInLoopThread() || calling_pending_functors) {
+        wakeup();
+    }
+}
+
+bool EpollManager::isInLoopThread() const {
+    return thread_id.load() == std::this_thread::get_id();
+}
+
+void EpollManager::wakeup() {
+    uint64_t one = 1;
+    ssize_t n = ::write(wakeup_fd, &one, sizeof(one));
+    if (n != sizeof(one)) {
+        LOG_ERROR("Failed to write eventfd: {}", strerror(errno));
+    }
+}
+
+void EpollManager::handleWakeup() {
+    uint64_t count = 0;
+    ssize_t n = ::read(wakeup_fd, &count, sizeof(count));
+    if (n != sizeof(count) && errno != EAGAIN) {
+        LOG_ERROR("Failed to read eventfd: {}", strerror(errno));
+    }
+}
+
+void EpollManager::doPendingFunctors() {
+    // 交换出来再执行，缩小临界区，也避免回调中再次queueInLoop造成死锁
+    std::vector<Functor> functors;
+    calling_pending_functors = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        functors.swap(pending_functors);
+    }
+    for (const Functor &functor : functors) {
+        functor();
+    }
+    calling_pending_functors = false;
+}
+
+TimerId EpollManager::runAfter(int delay_ms, Functor cb) {
+    return timer_wheel.schedule(delay_ms, std::move(cb));
 }
+
+bool EpollManager::cancelTimer(TimerId id) { return timer_wheel.cancel(id); }
+
+bool EpollManager::refreshTimer(TimerId id) { return timer_wheel.refresh(id); }
+
+void EpollManager::setIdleTimeout(Channel &channel, int idle_ms, Functor cb) {
+    int fd = channel.getFd();
+    if (fd >= static_cast<int>(channels.size()) ||
+        channels[fd].channel.get() != &channel) {
+        LOG_ERROR("setIdleTimeout on unregistered fd: {}", fd);
+        return;
+    }
+    ChannelSlot &slot = channels[fd];
+    if (slot.idle_timer != 0) {
+        timer_wheel.cancel(slot.idle_timer);
+    }
+    // 定时器触发后句柄即失效，先清掉记录，回调中remove时就不会重复取消
+    uint32_t generation = slot.generation;
+    slot.idle_timer =
+        timer_wheel.schedule(idle_ms, [this, fd, generation, cb]() {
+            if (fd < static_cast<int>(channels.size()) &&
+                channels[fd].generation == generation) {
+                channels[fd].idle_timer = 0;
+            }
+            cb();
+        });
+}
+
+UringPoller *EpollManager::uring() const { return uring_poller; }
@@ -0,0 +1,60 @@
+#include "epollPoller.h"
+#include "log.h"
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+EpollPoller::EpollPoller(int max_events)
+    : max_events(max_events), events(max_events) {
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+        LOG_ERROR("Failed to create epoll file descriptor: {}",
+                  strerror(errno));
+        throw std::runtime_error("epoll_create1 failed");
+    }
+}
+
+EpollPoller::~EpollPoller() { close(epoll_fd); }
+
+void EpollPoller::add(int fd, uint32_t events, uint64_t token) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.u64 = token;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        LOG_ERROR("Failed to add fd to epoll: {}, error: {}", fd,
+                  strerror(errno));
+        throw std::runtime_error("epoll_ctl failed");
+    }
+}
+
+void EpollPoller::modify(int fd, uint32_t events, uint64_t token) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.u64 = token;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        LOG_ERROR("Failed to modify fd in epoll: {}, error: {}", fd,
+                  strerror(errno));
+        throw std::runtime_error("epoll_ctl failed");
+    }
+}
+
+void EpollPoller::remove(int fd) {
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+        LOG_ERROR("Failed to remove fd from epoll: {}, error: {}", fd,
+                  strerror(errno));
+    }
+}
+
+void EpollPoller::poll(int timeout, std::vector<PollEvent> &active) {
+    int num_fds = epoll_wait(epoll_fd, events.data(), max_events, timeout);
+    if (num_fds == -1) {
+        if (errno == EINTR) {
+            return;
+        }
+        LOG_ERROR("epoll_wait failed: {}", strerror(errno));
+        throw std::runtime_error("epoll_wait failed");
+    }
+    for (int i = 0; i < num_fds; i++) {
+        active.push_back(PollEvent{events[i].data.u64, events[i].events});
+    }
+}
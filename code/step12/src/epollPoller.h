@@ -0,0 +1,23 @@
+#ifndef EPOLLPOLLER_H
+#define EPOLLPOLLER_H
+
+#include "poller.h"
+#include <sys/epoll.h>
+#include <vector>
+
+class EpollPoller : public Poller {
+  public:
+    EpollPoller(int max_events);
+    ~EpollPoller();
+    void add(int fd, uint32_t events, uint64_t token) override;
+    void modify(int fd, uint32_t events, uint64_t token) override;
+    void remove(int fd) override;
+    void poll(int timeout, std::vector<PollEvent> &active) override;
+
+  private:
+    int epoll_fd;
+    int max_events;
+    std::vector<struct epoll_event> events;
+};
+
+#endif // EPOLLPOLLER_H
@@ -0,0 +1,80 @@
+#ifndef LOG_H
+#define LOG_H
+
+// 编译期日志级别。低于SPDLOG_ACTIVE_LEVEL的日志语句在预处理阶段就被
+// 去掉，参数也不会求值；达到级别的再按logger的运行时级别过滤。
+// SPDLOG_ACTIVE_LEVEL由CMake按目标统一定义（见CMakeLists.txt中的
+// LOG_LEVEL），同一目标的所有源文件必须一致，否则以spdlog的默认值INFO为准。
+// 每个事件都会走到的路径只用TRACE/DEBUG，默认编译配置下不产生任何代码。
+//
+// BinaryLog::open之后，通过运行时级别过滤的日志不再由spdlog格式化，
+// 而是写成二进制记录（见binaryLog.h），用log_decode离线还原。
+#include "binaryLog.h"
+#include <spdlog/spdlog.h>
+
+#define LOG_CALL(logger_ptr, level, ...)                                      \
+    do {                                                                      \
+        spdlog::logger *log_call_logger = (logger_ptr);                       \
+        if (!log_call_logger->should_log(level))                              \
+            break;                                                            \
+        if (BinaryLog::enabled()) {                                           \
+            static const uint16_t log_call_format = BinaryLog::registerFormat( \
+                level, log_call_logger->name(), __FILE__, __LINE__,           \
+                __VA_ARGS__);                                                 \
+            BinaryLog::write(log_call_format, __VA_ARGS__);                   \
+        } else {                                                              \
+            SPDLOG_LOGGER_CALL(log_call_logger, level, __VA_ARGS__);          \
+        }                                                                     \
+    } while (0)
+
+#define LOG_DEFAULT_CALL(level, ...)                                          \
+    LOG_CALL(spdlog::default_logger_raw(), level, __VA_ARGS__)
+#define LOG_LOGGER_CALL(logger, level, ...)                                   \
+    LOG_CALL(&*(logger), level, __VA_ARGS__)
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_DEFAULT_CALL(spdlog::level::trace, __VA_ARGS__)
+#define LOGGER_TRACE(logger, ...)                                             \
+    LOG_LOGGER_CALL(logger, spdlog::level::trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) (void)0
+#define LOGGER_TRACE(logger, ...) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_DEFAULT_CALL(spdlog::level::debug, __VA_ARGS__)
+#define LOGGER_DEBUG(logger, ...)                                             \
+    LOG_LOGGER_CALL(logger, spdlog::level::debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) (void)0
+#define LOGGER_DEBUG(logger, ...) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_DEFAULT_CALL(spdlog::level::info, __VA_ARGS__)
+#define LOGGER_INFO(logger, ...)                                              \
+    LOG_LOGGER_CALL(logger, spdlog::level::info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) (void)0
+#define LOGGER_INFO(logger, ...) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_DEFAULT_CALL(spdlog::level::warn, __VA_ARGS__)
+#define LOGGER_WARN(logger, ...)                                              \
+    LOG_LOGGER_CALL(logger, spdlog::level::warn, __VA_ARGS__)
+#else
+#define LOG_WARN(...) (void)0
+#define LOGGER_WARN(logger, ...) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_DEFAULT_CALL(spdlog::level::err, __VA_ARGS__)
+#define LOGGER_ERROR(logger, ...)                                             \
+    LOG_LOGGER_CALL(logger, spdlog::level::err, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) (void)0
+#define LOGGER_ERROR(logger, ...) (void)0
+#endif
+
+#endif // LOG_H
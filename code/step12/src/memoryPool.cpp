@@ -0,0 +1,143 @@
+#include "memoryPool.h"
+#include <cstdlib>
+#include <new>
+
+// 所有存活的池，以id为下标；线程退出时据此判断池是否已经析构
+static std::mutex registry_mutex;
+static std::vector<MemoryPool *> registry;
+
+// 每个线程一份，下标是池的id；线程退出时把缓存的块还给各自的池
+struct ThreadCacheHolder {
+    std::vector<MemoryPool::ThreadCache> caches;
+
+    ~ThreadCacheHolder() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (size_t i = 0; i < caches.size(); ++i) {
+            if (caches[i].count > 0 && i < registry.size() && registry[i]) {
+                registry[i]->flush(caches[i], caches[i].count);
+            }
+        }
+    }
+};
+
+static thread_local ThreadCacheHolder thread_caches;
+
+MemoryPool::MemoryPool(size_t block_size, size_t blocks_per_slab)
+    : blocks_per_slab(blocks_per_slab), central(nullptr), central_count(0) {
+    // 块至少能放下一个链表指针，并按max_align_t对齐
+    const size_t align = alignof(std::max_align_t);
+    if (block_size < sizeof(FreeBlock))
+        block_size = sizeof(FreeBlock);
+    this->block_size = (block_size + align - 1) / align * align;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    id = registry.size();
+    registry.push_back(this);
+}
+
+MemoryPool::~MemoryPool() {
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry[id] = nullptr;
+    }
+    // 当前线程缓存中的块指向即将释放的slab，直接丢弃
+    if (id < thread_caches.caches.size()) {
+        thread_caches.caches[id].head = nullptr;
+        thread_caches.caches[id].count = 0;
+    }
+    for (void *slab : slabs) {
+        free(slab);
+    }
+}
+
+void *MemoryPool::allocate() {
+    ThreadCache &cache = localCache();
+    if (cache.head == nullptr) {
+        refill(cache);
+    }
+    FreeBlock *block = cache.head;
+    cache.head = block->next;
+    cache.count--;
+    return block;
+}
+
+void MemoryPool::deallocate(void *block) {
+    if (block == nullptr)
+        return;
+    ThreadCache &cache = localCache();
+    FreeBlock *free_block = static_cast<FreeBlock *>(block);
+    free_block->next = cache.head;
+    cache.head = free_block;
+    cache.count++;
+    // 留下一半，避免在阈值附近反复与中心链表交换
+    if (cache.count >= kCacheCapacity) {
+        flush(cache, kBatchSize);
+    }
+}
+
+size_t MemoryPool::blockSize() const { return block_size; }
+
+size_t MemoryPool::slabCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return slabs.size();
+}
+
+MemoryPool::ThreadCache &MemoryPool::localCache() {
+    std::vector<ThreadCache> &caches = thread_caches.caches;
+    if (id >= caches.size()) {
+        // 每个线程第一次使用这个池时才会扩容
+        caches.resize(id + 1, ThreadCache{nullptr, 0});
+    }
+    return caches[id];
+}
+
+void MemoryPool::refill(ThreadCache &cache) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (central_count < kBatchSize) {
+        grow();
+    }
+    // 摘下中心链表的前kBatchSize个块，整段接到线程缓存上
+    FreeBlock *first = central;
+    FreeBlock *last = central;
+    size_t n = 1;
+    while (n < kBatchSize && last->next) {
+        last = last->next;
+        n++;
+    }
+    central = last->next;
+    central_count -= n;
+    last->next = cache.head;
+    cache.head = first;
+    cache.count += n;
+}
+
+void MemoryPool::flush(ThreadCache &cache, size_t count) {
+    // 先在锁外把要归还的count个块切成一段
+    FreeBlock *first = cache.head;
+    FreeBlock *last = first;
+    for (size_t i = 1; i < count; ++i) {
+        last = last->next;
+    }
+    cache.head = last->next;
+    cache.count -= count;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    last->next = central;
+    central = first;
+    central_count += count;
+}
+
+void MemoryPool::grow() {
+    // 调用者已持有mutex
+    char *slab = static_cast<char *>(malloc(block_size * blocks_per_slab));
+    if (slab == nullptr) {
+        throw std::bad_alloc();
+    }
+    slabs.push_back(slab);
+    for (size_t i = 0; i < blocks_per_slab; ++i) {
+        FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + i * block_size);
+        block->next = central;
+        central = block;
+    }
+    central_count += blocks_per_slab;
+}
@@ -0,0 +1,58 @@
+#ifndef MEMORYPOOL_H
+#define MEMORYPOOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// 定长内存块的slab分配器，用于AioRequest和I/O缓冲区。
+// 内存按slab整块申请且不归还系统；每个线程有自己的缓存，
+// 大部分allocate/deallocate不加锁，缓存空了或满了时才与中心空闲链表
+// 成批交换kBatchSize个块，稳态下不会再调用malloc。
+// 池必须比使用它的线程活得更久，线程退出时缓存中的块会还给中心链表。
+class MemoryPool {
+  public:
+    MemoryPool(size_t block_size, size_t blocks_per_slab = 64);
+    ~MemoryPool();
+    MemoryPool(const MemoryPool &) = delete;
+    MemoryPool &operator=(const MemoryPool &) = delete;
+
+    void *allocate();
+    void deallocate(void *block);
+    size_t blockSize() const;
+    // 已经向系统申请的slab数量，用于观察稳态下是否还在增长
+    size_t slabCount();
+
+  private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct ThreadCache {
+        FreeBlock *head;
+        size_t count;
+    };
+
+    friend struct ThreadCacheHolder;
+
+    static const size_t kBatchSize = 32;
+    static const size_t kCacheCapacity = 2 * kBatchSize;
+
+    ThreadCache &localCache();
+    // 从中心链表一次取kBatchSize个块放入线程缓存，不够时先申请新slab
+    void refill(ThreadCache &cache);
+    // 把线程缓存中的count个块一次还给中心链表
+    void flush(ThreadCache &cache, size_t count);
+    void grow();
+
+    size_t block_size;
+    size_t blocks_per_slab;
+    size_t id; // 在线程缓存数组中的下标
+
+    std::mutex mutex; // 保护central和slabs
+    FreeBlock *central;
+    size_t central_count;
+    std::vector<void *> slabs;
+};
+
+#endif // MEMORYPOOL_H
@@ -0,0 +1,27 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <cstdint>
+#include <vector>
+
+// 可选的I/O多路复用后端，启动时选择
+enum class PollerType { kEpoll, kUring };
+
+struct PollEvent {
+    uint64_t token;  // 注册时传入的标识，由EpollManager解释
+    uint32_t events; // EPOLLIN/EPOLLOUT/EPOLLERR/EPOLLHUP...
+};
+
+// EpollManager与具体后端之间的接口，只负责fd就绪通知，
+// Channel的管理和回调分发仍由EpollManager完成
+class Poller {
+  public:
+    virtual ~Poller() {}
+    virtual void add(int fd, uint32_t events, uint64_t token) = 0;
+    virtual void modify(int fd, uint32_t events, uint64_t token) = 0;
+    virtual void remove(int fd) = 0;
+    // 等待事件，就绪的fd追加到active中；timeout单位毫秒，-1表示一直等待
+    virtual void poll(int timeout, std::vector<PollEvent> &active) = 0;
+};
+
+#endif // POLLER_H
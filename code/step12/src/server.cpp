@@ -1,53 +1,97 @@
+#include "asyncLogSink.h"
+#include "log.h"
 #include "server.h"
+#include "uringPoller.h"
 #include <arpa/inet.h>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <unistd.h>
 
 #define MAX_EVENTS 10
+#define ACCEPT_METRICS_INTERVAL_MS 5000
+// io_uring模式下accept出错后重新提交前等待的时间
+#define URING_ACCEPT_RETRY_MS 1000
+#define RESPONSE_PREFIX "server: "
+#define RESPONSE_PREFIX_LEN (sizeof(RESPONSE_PREFIX) - 1)
+#define LOG_FILE "step12_server.log"
+#define BINARY_LOG_FILE "step12_server.blog"
 
-Server::Server(int port, int buffer_size, int max_pending_connections)
+Server::Server(int port, int buffer_size, int max_pending_connections,
+               PollerType poller_type)
     : port(port), buffer_size(buffer_size),
       max_pending_connections(max_pending_connections),
-      addrlen(sizeof(address)), epoll_manager(MAX_EVENTS) {
-    logger = spdlog::stdout_color_mt("server");
+      poller_type(poller_type), addrlen(sizeof(address)),
+      epoll_manager(MAX_EVENTS, 100, poller_type),
+      request_pool(sizeof(AioRequest)),
+      buffer_pool(RESPONSE_PREFIX_LEN + buffer_size), uring_idle_fd(-1) {
+    // main中开启异步日志时已经注册了同名logger
+    logger = spdlog::get("server");
+    if (!logger)
+        logger = spdlog::stdout_color_mt("server");
     logger->set_level(spdlog::level::info);
     init();
 }
 
-Server::~Server() { close(server_fd); }
+Server::~Server() {
+    close(server_fd);
+    if (uring_idle_fd >= 0)
+        close(uring_idle_fd);
+}
 
 void Server::init() {
     server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd == 0) {
-        logger->error("socket creation failed");
+        LOGGER_ERROR(logger, "socket creation failed");
         exit(EXIT_FAILURE);
     }
 
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
 
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        logger->error("bind failed");
+        LOGGER_ERROR(logger, "bind failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
     if (listen(server_fd, max_pending_connections) < 0) {
-        logger->error("listen failed");
+        LOGGER_ERROR(logger, "listen failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
-    auto server_channel = std::make_shared<Channel>(server_fd);
-    server_channel->setEvents(EPOLLIN);
-    server_channel->setReadCallback([this, server_channel]() {
-        logger->info("Connecting...");
-        this->accept_connection(server_channel);
-    });
-    epoll_manager.add(*server_channel);
+    if (poller_type == PollerType::kUring) {
+        // accept、读、写都以完成事件的形式从io_uring返回，
+        // 一个multishot accept请求持续产生新连接
+        uring_idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (uring_idle_fd < 0)
+            LOGGER_ERROR(logger, "open /dev/null for spare fd failed: {}",
+                         strerror(errno));
+        uring_start_accept();
+        LOGGER_INFO(logger, "Server is running with io_uring...");
+        return;
+    }
+
+    // AIO完成事件经由完成队列回到事件循环线程中处理
+    aio_queue.reset(new AioCompletionQueue(
+        epoll_manager, [this](AioRequest *req) { this->aio_complete(req); }));
 
-    logger->info("Server is running and waiting for connections...");
+    acceptor.reset(new Acceptor(&epoll_manager, server_fd));
+    // 读写由glibc AIO的线程以阻塞方式完成，客户端socket不能是非阻塞的
+    acceptor->setAcceptFlags(SOCK_CLOEXEC);
+    acceptor->setMetricsInterval(ACCEPT_METRICS_INTERVAL_MS);
+    acceptor->setNewConnectionCallback(
+        [this](int client_fd, const struct sockaddr_in &peer) {
+            this->new_connection(client_fd, peer);
+        });
+    acceptor->start();
+
+    LOGGER_INFO(logger, "Server is running and waiting for connections...");
 }
 
 void Server::run() {
@@ -56,94 +100,276 @@ void Server::run() {
     }
 }
 
-void Server::accept_connection(std::shared_ptr<Channel> server_channel) {
-    struct sockaddr_in client_addr;
-    socklen_t addrlen = sizeof(client_addr);
-    int client_fd =
-        accept(server_fd, (struct sockaddr *)&client_addr, &addrlen);
-    if (client_fd < 0) {
-        logger->error("accept failed");
+void Server::new_connection(int client_fd, const struct sockaddr_in &peer) {
+    // 建连风暴时逐个输出连接信息开销很大，只在debug级别输出
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+    if (logger->should_log(spdlog::level::debug)) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+        LOGGER_DEBUG(logger, "Connection from {}:{}", ip, ntohs(peer.sin_port));
+    }
+#else
+    (void)peer;
+#endif
+
+    // 客户端的读写完全由AIO驱动，不再注册到epoll，
+    // 每个连接一个AioRequest，读和写交替复用它和它的缓冲区
+    AioRequest *req = static_cast<AioRequest *>(request_pool.allocate());
+    memset(req, 0, sizeof(AioRequest));
+    req->fd = client_fd;
+    req->buffer = static_cast<char *>(buffer_pool.allocate());
+    // 响应前缀只写一次，读到的数据紧跟在它后面，回写时不再拷贝
+    memcpy(req->buffer, RESPONSE_PREFIX, RESPONSE_PREFIX_LEN);
+    start_read(req);
+}
+
+void Server::start_read(AioRequest *req) {
+    memset(&req->cb, 0, sizeof(struct aiocb));
+    req->op = AioRequest::kRead;
+    req->cb.aio_fildes = req->fd;
+    req->cb.aio_buf = req->buffer + RESPONSE_PREFIX_LEN;
+    req->cb.aio_nbytes = buffer_size;
+    if (aio_queue->submit(req) == -1) {
+        LOGGER_ERROR(logger, "aio_read failed: {}", strerror(errno));
+        close_request(req);
+    }
+}
+
+void Server::start_write(AioRequest *req, size_t offset, size_t len) {
+    memset(&req->cb, 0, sizeof(struct aiocb));
+    req->op = AioRequest::kWrite;
+    req->cb.aio_fildes = req->fd;
+    req->cb.aio_buf = req->buffer + offset;
+    req->cb.aio_nbytes = len;
+    if (aio_queue->submit(req) == -1) {
+        LOGGER_ERROR(logger, "aio_write failed: {}", strerror(errno));
+        close_request(req);
+    }
+}
+
+void Server::aio_complete(AioRequest *req) {
+    if (req->op == AioRequest::kRead) {
+        read_complete(req);
+    } else {
+        write_complete(req);
+    }
+}
+
+void Server::read_complete(AioRequest *req) {
+    // aio_error要在aio_return之前读取，任一个报错都按失败处理
+    int err = aio_error(&req->cb);
+    int ret = aio_return(&req->cb);
+    if (err != 0 || ret <= 0) {
+        if (err != 0 || ret < 0)
+            LOGGER_ERROR(logger, "aio_read failed: {}", strerror(err));
+        else
+            LOGGER_DEBUG(logger, "Client disconnected, fd: {}", req->fd);
+        close_request(req);
         return;
     }
 
-    logger->info("Connection from {}:{}", inet_ntoa(client_addr.sin_addr),
-                 ntohs(client_addr.sin_port));
-
-    auto client_channel = std::make_shared<Channel>(client_fd);
-    client_channel->setEvents(EPOLLIN);
-    client_channel->setReadCallback(
-        [this, client_channel]() { this->handle_client(client_channel); });
-    epoll_manager.add(*client_channel);
-
-    // Initiate asynchronous read
-    struct aiocb *cb = new struct aiocb;
-    memset(cb, 0, sizeof(struct aiocb));
-    cb->aio_fildes = client_fd;
-    cb->aio_buf = malloc(buffer_size);
-    cb->aio_nbytes = buffer_size;
-    cb->aio_sigevent.sigev_notify = SIGEV_THREAD;
-    cb->aio_sigevent.sigev_notify_function = [](sigval_t sigval) {
-        Server *server = static_cast<Server *>(sigval.sival_ptr);
-        server->read_complete(sigval);
-    };
-    cb->aio_sigevent.sigev_value.sival_ptr = this;
-
-    if (aio_read(cb) == -1) {
-        logger->error("aio_read failed");
-        close(client_fd);
-        free(cb->aio_buf);
-        delete cb;
-    }
-}
-
-void Server::read_complete(sigval_t sigval) {
-    struct aiocb *cb = (struct aiocb *)sigval.sival_ptr;
-    int ret = aio_return(cb);
-    if (ret > 0) {
-        logger->info("Read data: {}", std::string((char *)cb->aio_buf, ret));
-        std::string response =
-            "server: " + std::string((char *)cb->aio_buf, ret);
-
-        // Initiate asynchronous write
-        memset(cb, 0, sizeof(struct aiocb));
-        cb->aio_fildes = cb->aio_fildes;
-        cb->aio_buf = strdup(response.c_str());
-        cb->aio_nbytes = response.length();
-        cb->aio_sigevent.sigev_notify = SIGEV_THREAD;
-        cb->aio_sigevent.sigev_notify_function = [](sigval_t sigval) {
-            Server *server = static_cast<Server *>(sigval.sival_ptr);
-            server->write_complete(sigval);
-        };
-        cb->aio_sigevent.sigev_value.sival_ptr = this;
-
-        if (aio_write(cb) == -1) {
-            logger->error("aio_write failed");
-            close(cb->aio_fildes);
-            free((void *)cb->aio_buf);
-            delete cb;
+    const char *data = req->buffer + RESPONSE_PREFIX_LEN;
+    LOGGER_DEBUG(logger, "Read data: {}", spdlog::string_view_t(data, ret));
+    if (ret == 4 && memcmp(data, "exit", 4) == 0) {
+        close_request(req);
+        return;
+    }
+    start_write(req, 0, RESPONSE_PREFIX_LEN + ret);
+}
+
+void Server::write_complete(AioRequest *req) {
+    int err = aio_error(&req->cb);
+    int ret = aio_return(&req->cb);
+    if (err != 0 || ret == -1) {
+        LOGGER_ERROR(logger, "aio_write failed: {}", strerror(err));
+        close_request(req);
+        return;
+    }
+    char *sent = static_cast<char *>(const_cast<void *>(req->cb.aio_buf));
+    LOGGER_DEBUG(logger, "Sent data: {}", spdlog::string_view_t(sent, ret));
+    // 对端接收慢、发送缓冲区满时可能只写了一部分，接着写剩下的
+    size_t remaining = req->cb.aio_nbytes - ret;
+    if (remaining > 0) {
+        start_write(req, sent + ret - req->buffer, remaining);
+        return;
+    }
+    // 写完继续读下一个请求，直到对端关闭或发送exit
+    start_read(req);
+}
+
+void Server::close_request(AioRequest *req) {
+    close(req->fd);
+    buffer_pool.deallocate(req->buffer);
+    request_pool.deallocate(req);
+}
+
+void Server::uring_start_accept() {
+    epoll_manager.uring()->acceptMultishot(
+        server_fd,
+        [this](int client_fd) { this->uring_accept_complete(client_fd); });
+}
+
+void Server::uring_accept_complete(int client_fd) {
+    if (client_fd < 0) {
+        // multishot accept出错后已经停止。fd耗尽时和Acceptor一样借备用fd
+        // 接下一个连接关掉，接到了才马上重新提交；其他错误（如ENOMEM）
+        // 过一段时间再提交，不让事件循环空转
+        int err = -client_fd;
+        if (err == ECONNABORTED || err == EINTR ||
+            ((err == EMFILE || err == ENFILE) && uring_shed_connection())) {
+            uring_start_accept();
+            return;
         }
-    } else {
-        logger->error("aio_read failed or client disconnected");
-        close(cb->aio_fildes);
-        free(cb->aio_buf);
-        delete cb;
+        LOGGER_ERROR(logger, "accept failed: {}, retry in {} ms",
+                     strerror(err), URING_ACCEPT_RETRY_MS);
+        epoll_manager.runAfter(URING_ACCEPT_RETRY_MS,
+                               [this]() { this->uring_start_accept(); });
+        return;
     }
+    LOGGER_DEBUG(logger, "Accepted connection, fd: {}", client_fd);
+    uring_connections[client_fd] = UringConnection();
+    epoll_manager.uring()->recvMultishot(
+        client_fd, [this, client_fd](const char *data, int len) {
+            this->uring_read_complete(client_fd, data, len);
+        });
 }
 
-void Server::write_complete(sigval_t sigval) {
-    struct aiocb *cb = (struct aiocb *)sigval.sival_ptr;
-    int ret = aio_return(cb);
-    if (ret != -1) {
-        logger->info("Sent data: {}",
-                     std::string((char *)cb->aio_buf, cb->aio_nbytes));
-    } else {
-        logger->error("aio_write failed");
+void Server::uring_read_complete(int client_fd, const char *data, int len) {
+    auto it = uring_connections.find(client_fd);
+    if (it == uring_connections.end())
+        return;
+    UringConnection &conn = it->second;
+    if (len <= 0) {
+        if (len < 0)
+            LOGGER_ERROR(logger, "recv failed: {}", strerror(-len));
+        else
+            LOGGER_DEBUG(logger, "Client disconnected, fd: {}", client_fd);
+        uring_close(client_fd, conn);
+        return;
+    }
+
+    std::string request(data, len);
+    LOGGER_DEBUG(logger, "Read data: {}", request);
+    if (request == "exit") {
+        uring_close(client_fd, conn);
+        return;
+    }
+
+    // 响应在发送完成前一直留在outbox里，deque在两端增删不会移动其他元素
+    conn.outbox.push_back(RESPONSE_PREFIX + request);
+    if (!conn.sending)
+        uring_send_next(client_fd, conn);
+}
+
+bool Server::uring_shed_connection() {
+    if (uring_idle_fd < 0)
+        return false;
+    // 这时内核中没有accept请求，临时把监听socket设成非阻塞，
+    // 排队的连接已经被对端放弃时accept不会卡住事件循环
+    int flags = fcntl(server_fd, F_GETFL, 0);
+    fcntl(server_fd, F_SETFL, flags | O_NONBLOCK);
+    close(uring_idle_fd);
+    int fd = accept(server_fd, nullptr, nullptr);
+    if (fd >= 0) {
+        close(fd);
+        LOGGER_WARN(logger,
+                    "accept failed: too many open files, connection dropped");
+    }
+    uring_idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    fcntl(server_fd, F_SETFL, flags);
+    return fd >= 0;
+}
+
+void Server::uring_send_next(int client_fd, UringConnection &conn) {
+    const std::string &response = conn.outbox.front();
+    conn.sending = true;
+    epoll_manager.uring()->send(client_fd, response.data() + conn.sent,
+                                response.size() - conn.sent,
+                                [this, client_fd](int res) {
+                                    this->uring_write_complete(client_fd, res);
+                                });
+}
+
+void Server::uring_write_complete(int client_fd, int res) {
+    auto it = uring_connections.find(client_fd);
+    if (it == uring_connections.end())
+        return;
+    UringConnection &conn = it->second;
+    conn.sending = false;
+    if (res <= 0) {
+        LOGGER_ERROR(logger, "send failed on fd {}: {}", client_fd,
+                     res < 0 ? strerror(-res) : "no bytes written");
+        conn.outbox.clear();
+        uring_close(client_fd, conn);
+        return;
     }
-    close(cb->aio_fildes);
-    free((void *)cb->aio_buf);
-    delete cb;
+    LOGGER_DEBUG(logger, "Sent {} bytes to fd {}", res, client_fd);
+
+    // 对端接收慢、发送缓冲区满时可能只写了一部分，接着写剩下的
+    conn.sent += res;
+    if (conn.sent == conn.outbox.front().size()) {
+        conn.outbox.pop_front();
+        conn.sent = 0;
+    }
+    if (!conn.outbox.empty())
+        uring_send_next(client_fd, conn);
+    else if (conn.closing)
+        uring_close(client_fd, conn);
 }
 
-void Server::handle_client(std::shared_ptr<Channel> client_channel) {
-    // 不再需要实现此方法，因为I/O操作已在read_complete和write_complete中处理
+// 先取消recv，内核中还有SEND时等它完成后再close
+void Server::uring_close(int client_fd, UringConnection &conn) {
+    if (!conn.closing) {
+        conn.closing = true;
+        epoll_manager.uring()->cancel(client_fd);
+    }
+    if (conn.sending)
+        return;
+    close(client_fd);
+    uring_connections.erase(client_fd);
+}
+
+int main(int argc, char *argv[]) {
+    const int PORT = 8080;
+    const int BUFFER_SIZE = 1024;
+    const int MAX_PENDING_CONNECTIONS = SOMAXCONN;
+
+    // ./step12_server [uring] [asynclog|asynclog_block|binlog]
+    // uring 使用io_uring，默认使用POSIX AIO；
+    // asynclog 把日志异步写到LOG_FILE，缓冲区满时丢弃，asynclog_block 时等待；
+    // binlog 把日志写成二进制记录到BINARY_LOG_FILE，用step12_log_decode查看
+    PollerType poller_type = PollerType::kEpoll;
+    bool async_log = false;
+    bool binary_log = false;
+    AsyncLogSink::OverflowPolicy policy = AsyncLogSink::OverflowPolicy::kDrop;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "uring") {
+            poller_type = PollerType::kUring;
+        } else if (arg == "asynclog") {
+            async_log = true;
+        } else if (arg == "asynclog_block") {
+            async_log = true;
+            policy = AsyncLogSink::OverflowPolicy::kBlock;
+        } else if (arg == "binlog") {
+            binary_log = true;
+        }
+    }
+    if (binary_log && !BinaryLog::open(BINARY_LOG_FILE)) {
+        LOG_ERROR("Failed to open binary log {}", BINARY_LOG_FILE);
+        return 1;
+    }
+    if (async_log) {
+        // 默认logger和server的logger共用一个sink，日志由后台线程写文件
+        std::shared_ptr<AsyncLogSink> sink =
+            std::make_shared<AsyncLogSink>(LOG_FILE, policy);
+        spdlog::set_default_logger(std::make_shared<spdlog::logger>("", sink));
+        spdlog::register_logger(
+            std::make_shared<spdlog::logger>("server", sink));
+    }
+
+    Server server(PORT, BUFFER_SIZE, MAX_PENDING_CONNECTIONS, poller_type);
+    server.run();
+
+    return 0;
 }
@@ -1,36 +1,78 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "acceptor.h"
+#include "aioCompletionQueue.h"
 #include "channel.h"
 #include "epollManager.h"
+#include "memoryPool.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include <aio.h>
-#include <asm-generic/siginfo.h>
+#include <csignal>
+#include <deque>
 #include <memory>
 #include <netinet/in.h>
 #include <spdlog/spdlog.h>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 class Server {
   public:
-    Server(int port, int buffer_size, int max_pending_connections);
+    Server(int port, int buffer_size, int max_pending_connections,
+           PollerType poller_type = PollerType::kEpoll);
     ~Server();
     void init();
     void run();
-    void accept_connection(std::shared_ptr<Channel> server_channel);
-    void handle_client(std::shared_ptr<Channel> client_channel);
-    void read_complete(sigval_t sigval);
-    void write_complete(sigval_t sigval);
+    void new_connection(int client_fd, const struct sockaddr_in &peer);
+    void start_read(AioRequest *req);
+    // 从req->buffer的offset处开始写len字节
+    void start_write(AioRequest *req, size_t offset, size_t len);
+    // 以下AIO完成回调都由aio_queue在事件循环线程中调用
+    void aio_complete(AioRequest *req);
+    void read_complete(AioRequest *req);
+    void write_complete(AioRequest *req);
+    void close_request(AioRequest *req);
+    // io_uring模式下的完成回调，全部在事件循环线程中执行
+    void uring_start_accept();
+    void uring_accept_complete(int client_fd);
+    void uring_read_complete(int client_fd, const char *data, int len);
+    void uring_write_complete(int client_fd, int res);
 
   private:
+    // io_uring模式下一个连接的发送状态，只在事件循环线程中访问。
+    // 同一个fd同时只有一个SEND在内核中，短写时接着发剩下的部分，
+    // 后面的响应排队，字节不会交错；关闭要等SEND完成，
+    // 否则内核中的SEND可能写到被新连接复用的fd上
+    struct UringConnection {
+        UringConnection() : sent(0), sending(false), closing(false) {}
+
+        std::deque<std::string> outbox; // 待发送的响应，front正在发送
+        size_t sent;                    // front已经发出的字节数
+        bool sending;                   // 有SEND在内核中
+        bool closing;                   // recv已经取消，发完就close
+    };
+
+    // fd耗尽时借备用fd接下一个排队的连接并立即关闭，返回是否接到了连接
+    bool uring_shed_connection();
+    void uring_send_next(int client_fd, UringConnection &conn);
+    void uring_close(int client_fd, UringConnection &conn);
+
     int server_fd;
     int port;
     int buffer_size;
     int max_pending_connections;
+    PollerType poller_type;
     socklen_t addrlen;
     struct sockaddr_in address;
     EpollManager epoll_manager;
+    std::unique_ptr<AioCompletionQueue> aio_queue;
+    std::unique_ptr<Acceptor> acceptor; // 只在AIO模式下使用
+    MemoryPool request_pool; // AioRequest
+    MemoryPool buffer_pool;  // 响应前缀 + buffer_size字节的读写缓冲区
     std::shared_ptr<spdlog::logger> logger;
+    std::unordered_map<int, UringConnection> uring_connections;
+    int uring_idle_fd; // io_uring模式下的备用fd，用法同Acceptor
 };
 
 #endif // SERVER_H
@@ -0,0 +1,496 @@
+#include "log.h"
+#include "uringPoller.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define BUFFER_GROUP_ID 1
+#define USER_DATA_TYPE_SHIFT 56
+#define USER_DATA_VALUE_MASK ((1ULL << USER_DATA_TYPE_SHIFT) - 1)
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags, void *arg, size_t argsz) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                    min_complete, flags, arg, argsz));
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg,
+                             unsigned nr_args) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+UringPoller::UringPoller(unsigned entries, unsigned buffer_count,
+                         unsigned buffer_size)
+    : sqe_tail(0), buf_ring(nullptr), buffer_count(buffer_count),
+      buffer_size(buffer_size), buf_tail(0), buffers(nullptr), free_op(-1) {
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * kCqMultiplier;
+    ring_fd = io_uring_setup(entries, &params);
+    if (ring_fd < 0) {
+        LOG_ERROR("io_uring_setup failed: {}", strerror(errno));
+        throw std::runtime_error("io_uring_setup failed");
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        close(ring_fd);
+        throw std::runtime_error("io_uring without IORING_FEAT_EXT_ARG");
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes +
+                   params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_ring_size > sq_ring_size)
+            sq_ring_size = cq_ring_size;
+        cq_ring_size = sq_ring_size;
+    }
+    sq_ptr = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) {
+        close(ring_fd);
+        throw std::runtime_error("mmap sq ring failed");
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ptr = sq_ptr;
+    } else {
+        cq_ptr = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) {
+            munmap(sq_ptr, sq_ring_size);
+            close(ring_fd);
+            throw std::runtime_error("mmap cq ring failed");
+        }
+    }
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = static_cast<struct io_uring_sqe *>(
+        mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) {
+        if (cq_ptr != sq_ptr)
+            munmap(cq_ptr, cq_ring_size);
+        munmap(sq_ptr, sq_ring_size);
+        close(ring_fd);
+        throw std::runtime_error("mmap sqes failed");
+    }
+
+    char *sq = static_cast<char *>(sq_ptr);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_flags = reinterpret_cast<unsigned *>(sq + params.sq_off.flags);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqe_tail = *sq_tail;
+
+    char *cq = static_cast<char *>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    setupBufferRing();
+    LOG_INFO("io_uring ready, sq entries: {}, cq entries: {}, "
+             "provided buffers: {} x {}",
+             params.sq_entries, params.cq_entries, this->buffer_count,
+             this->buffer_size);
+}
+
+UringPoller::~UringPoller() {
+    close(ring_fd);
+    if (buf_ring)
+        munmap(buf_ring, buf_ring_size);
+    delete[] buffers;
+    munmap(sqes, sqes_size);
+    if (cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_ring_size);
+    munmap(sq_ptr, sq_ring_size);
+}
+
+void UringPoller::setupBufferRing() {
+    // 环的大小必须是2的幂
+    unsigned entries = 1;
+    while (entries < buffer_count)
+        entries <<= 1;
+    buffer_count = entries;
+
+    buf_ring_size = entries * sizeof(struct io_uring_buf);
+    void *mem = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (mem == MAP_FAILED) {
+        throw std::runtime_error("mmap buffer ring failed");
+    }
+    buf_ring = static_cast<struct io_uring_buf_ring *>(mem);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = entries;
+    reg.bgid = BUFFER_GROUP_ID;
+    if (io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        LOG_ERROR("register provided buffer ring failed: {}", strerror(errno));
+        throw std::runtime_error("IORING_REGISTER_PBUF_RING failed");
+    }
+
+    buffers = new char[static_cast<size_t>(buffer_count) * buffer_size];
+    for (unsigned i = 0; i < buffer_count; ++i) {
+        recycleBuffer(static_cast<uint16_t>(i));
+    }
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+void UringPoller::recycleBuffer(uint16_t bid) {
+    // 只写入环中，下一次enter时再发布tail
+    // 不能用buf_ring->bufs：__DECLARE_FLEX_ARRAY在C++中的空结构体占1字节，
+    // bufs会偏移8字节，与内核的布局不一致
+    struct io_uring_buf *buf =
+        reinterpret_cast<struct io_uring_buf *>(buf_ring) +
+        (buf_tail & (buffer_count - 1));
+    buf->addr = reinterpret_cast<uint64_t>(buffers +
+                                           static_cast<size_t>(bid) *
+                                               buffer_size);
+    buf->len = buffer_size;
+    buf->bid = bid;
+    buf_tail++;
+}
+
+struct io_uring_sqe *UringPoller::getSqe() {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sqe_tail - head >= params.sq_entries) {
+        // 提交队列满了，先提交已有的请求
+        enter(false, 0);
+        head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (sqe_tail - head >= params.sq_entries) {
+            throw std::runtime_error("io_uring submission queue full");
+        }
+    }
+    unsigned index = sqe_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    sqe_tail++;
+    return sqe;
+}
+
+void UringPoller::enter(bool wait, int timeout) {
+    unsigned to_submit = sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    // CQ满时内核把完成事件暂存在溢出链表中，需要GETEVENTS才会搬回CQ
+    bool overflow =
+        __atomic_load_n(sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW;
+    if (to_submit == 0 && !wait && !overflow)
+        return;
+    // 归还的buffer在进入内核前统一发布，重新提交的recv才能拿到它们
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (wait) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout >= 0) {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    } else if (overflow) {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    int ret = io_uring_enter(ring_fd, to_submit, wait ? 1 : 0, flags,
+                             wait ? &arg : nullptr, wait ? sizeof(arg) : 0);
+    if (ret < 0 && errno != EINTR && errno != ETIME && errno != EAGAIN &&
+        errno != EBUSY) {
+        LOG_ERROR("io_uring_enter failed: {}", strerror(errno));
+        throw std::runtime_error("io_uring_enter failed");
+    }
+}
+
+void UringPoller::poll(int timeout, std::vector<PollEvent> &active) {
+    // 本轮积累的SQE和等待完成事件合并为一次系统调用
+    unsigned ready = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) - *cq_head;
+    enter(ready == 0 && timeout != 0, timeout);
+
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe cqe = cqes[head & *cq_mask];
+        head++;
+        // 先归还CQ槽位，回调中提交新请求时CQ不会被占满
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        handleCompletion(cqe, active);
+        tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    }
+}
+
+void UringPoller::handleCompletion(const struct io_uring_cqe &cqe,
+                                   std::vector<PollEvent> &active) {
+    switch (static_cast<OpType>(cqe.user_data >> USER_DATA_TYPE_SHIFT)) {
+    case kPoll:
+        handlePoll(cqe, active);
+        break;
+    case kAccept:
+        handleAccept(cqe);
+        break;
+    case kRecv:
+        handleRecv(cqe);
+        break;
+    case kSend:
+        handleSend(cqe);
+        break;
+    default:
+        break; // kCancel等内部请求不需要处理
+    }
+}
+
+uint64_t UringPoller::pollUserData(int fd) const {
+    uint64_t value = (static_cast<uint64_t>(polls[fd].seq & 0xffffff) << 32) |
+                     static_cast<uint32_t>(fd);
+    return (static_cast<uint64_t>(kPoll) << USER_DATA_TYPE_SHIFT) | value;
+}
+
+void UringPoller::add(int fd, uint32_t events, uint64_t token) {
+    if (fd >= static_cast<int>(polls.size())) {
+        polls.resize(fd + 1, PollEntry{0, 0, 0, false});
+    }
+    PollEntry &entry = polls[fd];
+    entry.token = token;
+    entry.events = events;
+    entry.seq++;
+    entry.active = true;
+    preparePoll(fd);
+}
+
+void UringPoller::modify(int fd, uint32_t events, uint64_t token) {
+    if (fd >= static_cast<int>(polls.size()) || !polls[fd].active) {
+        throw std::runtime_error("modify on unregistered fd");
+    }
+    preparePollRemove(fd);
+    add(fd, events, token);
+}
+
+void UringPoller::remove(int fd) {
+    if (fd >= static_cast<int>(polls.size()) || !polls[fd].active) {
+        return;
+    }
+    preparePollRemove(fd);
+    polls[fd].active = false;
+}
+
+void UringPoller::preparePoll(int fd) {
+    const PollEntry &entry = polls[fd];
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = entry.events & ~EPOLLET;
+    // 注册了EPOLLET时用multishot poll，相当于边缘触发；
+    // 默认的水平触发用单次poll，每次完成后在handlePoll中重新提交，
+    // 新的SQE在本轮回调执行完后才提交，内核会重新检查一次就绪状态
+    if (entry.events & EPOLLET)
+        sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = pollUserData(fd);
+}
+
+void UringPoller::preparePollRemove(int fd) {
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = pollUserData(fd);
+    sqe->user_data = static_cast<uint64_t>(kCancel) << USER_DATA_TYPE_SHIFT;
+}
+
+void UringPoller::handlePoll(const struct io_uring_cqe &cqe,
+                             std::vector<PollEvent> &active) {
+    uint64_t value = cqe.user_data & USER_DATA_VALUE_MASK;
+    int fd = static_cast<int>(value & 0xffffffff);
+    uint32_t seq = static_cast<uint32_t>(value >> 32);
+    if (fd >= static_cast<int>(polls.size()) || !polls[fd].active ||
+        (polls[fd].seq & 0xffffff) != seq) {
+        return; // 已经remove或重新注册过
+    }
+    if (cqe.res >= 0) {
+        active.push_back(
+            PollEvent{polls[fd].token, static_cast<uint32_t>(cqe.res)});
+    } else if (cqe.res != -ECANCELED) {
+        active.push_back(PollEvent{polls[fd].token, EPOLLERR});
+    }
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        preparePoll(fd); // multishot被内核终止，重新注册
+    }
+}
+
+int UringPoller::allocOp(OpType type, int fd) {
+    int index;
+    if (free_op != -1) {
+        index = free_op;
+        free_op = ops[index].next_free;
+    } else {
+        index = static_cast<int>(ops.size());
+        ops.push_back(Op());
+    }
+    Op &op = ops[index];
+    op.type = type;
+    op.fd = fd;
+    op.active = true;
+    op.in_flight = true;
+    op.next_free = -1;
+    return index;
+}
+
+void UringPoller::freeOp(int index) {
+    Op &op = ops[index];
+    if (op.type != kSend && op.fd < static_cast<int>(fd_ops.size()) &&
+        fd_ops[op.fd] == index) {
+        fd_ops[op.fd] = -1;
+    }
+    op.accept_cb = nullptr;
+    op.recv_cb = nullptr;
+    op.send_cb = nullptr;
+    op.active = false;
+    op.in_flight = false;
+    op.next_free = free_op;
+    free_op = index;
+}
+
+void UringPoller::acceptMultishot(int listen_fd, AcceptCallback cb) {
+    int index = allocOp(kAccept, listen_fd);
+    ops[index].accept_cb = std::move(cb);
+    if (listen_fd >= static_cast<int>(fd_ops.size()))
+        fd_ops.resize(listen_fd + 1, -1);
+    fd_ops[listen_fd] = index;
+    prepareAccept(index);
+}
+
+void UringPoller::prepareAccept(int index) {
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = ops[index].fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data =
+        (static_cast<uint64_t>(kAccept) << USER_DATA_TYPE_SHIFT) | index;
+    ops[index].in_flight = true;
+}
+
+void UringPoller::handleAccept(const struct io_uring_cqe &cqe) {
+    int index = static_cast<int>(cqe.user_data & USER_DATA_VALUE_MASK);
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (!more)
+        ops[index].in_flight = false;
+    if (ops[index].active) {
+        // 拷贝一份再调用，回调中新增请求可能导致ops扩容
+        AcceptCallback cb = ops[index].accept_cb;
+        cb(cqe.res);
+    }
+    // 正常结束（比如CQ溢出）时接着接收；出错结束时积压的连接还在监听队列里，
+    // 马上重新提交会立即再失败，交给回调处理
+    if (!more) {
+        if (ops[index].active && cqe.res >= 0)
+            prepareAccept(index);
+        else
+            freeOp(index);
+    }
+}
+
+void UringPoller::recvMultishot(int fd, RecvCallback cb) {
+    int index = allocOp(kRecv, fd);
+    ops[index].recv_cb = std::move(cb);
+    if (fd >= static_cast<int>(fd_ops.size()))
+        fd_ops.resize(fd + 1, -1);
+    fd_ops[fd] = index;
+    prepareRecv(index);
+}
+
+void UringPoller::prepareRecv(int index) {
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = ops[index].fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP_ID;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data =
+        (static_cast<uint64_t>(kRecv) << USER_DATA_TYPE_SHIFT) | index;
+    ops[index].in_flight = true;
+}
+
+void UringPoller::handleRecv(const struct io_uring_cqe &cqe) {
+    int index = static_cast<int>(cqe.user_data & USER_DATA_VALUE_MASK);
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (!more)
+        ops[index].in_flight = false;
+
+    const char *data = nullptr;
+    bool has_buffer = cqe.flags & IORING_CQE_F_BUFFER;
+    uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    if (has_buffer)
+        data = buffers + static_cast<size_t>(bid) * buffer_size;
+
+    // provided buffer暂时用光时内核返回-ENOBUFS，等buffer归还后重新提交即可
+    bool retry = cqe.res == -ENOBUFS;
+    if (ops[index].active && !retry) {
+        RecvCallback cb = ops[index].recv_cb;
+        cb(data, cqe.res);
+    }
+    if (has_buffer)
+        recycleBuffer(bid);
+
+    if (!more) {
+        if (ops[index].active && (cqe.res > 0 || retry)) {
+            prepareRecv(index);
+        } else {
+            freeOp(index);
+        }
+    }
+}
+
+void UringPoller::send(int fd, const char *data, size_t len, SendCallback cb) {
+    int index = allocOp(kSend, fd);
+    ops[index].send_cb = std::move(cb);
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data =
+        (static_cast<uint64_t>(kSend) << USER_DATA_TYPE_SHIFT) | index;
+}
+
+void UringPoller::handleSend(const struct io_uring_cqe &cqe) {
+    int index = static_cast<int>(cqe.user_data & USER_DATA_VALUE_MASK);
+    SendCallback cb = std::move(ops[index].send_cb);
+    freeOp(index);
+    if (cb)
+        cb(cqe.res);
+}
+
+void UringPoller::cancel(int fd) {
+    if (fd >= static_cast<int>(fd_ops.size()) || fd_ops[fd] == -1)
+        return;
+    int index = fd_ops[fd];
+    fd_ops[fd] = -1;
+    ops[index].active = false;
+    // Op统一在最后一个完成事件（没有F_MORE）处理完后释放，
+    // 这里只在请求还在内核中时发起取消
+    if (ops[index].in_flight) {
+        prepareCancel((static_cast<uint64_t>(ops[index].type)
+                       << USER_DATA_TYPE_SHIFT) |
+                      index);
+    }
+}
+
+void UringPoller::prepareCancel(uint64_t user_data) {
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = static_cast<uint64_t>(kCancel) << USER_DATA_TYPE_SHIFT;
+}
@@ -0,0 +1,126 @@
+#ifndef URINGPOLLER_H
+#define URINGPOLLER_H
+
+#include "poller.h"
+#include <cstddef>
+#include <functional>
+#include <linux/io_uring.h>
+#include <vector>
+
+// 基于io_uring的后端，直接使用系统调用，不依赖liburing。
+// 作为Poller时用POLL_ADD实现就绪通知，对Channel完全透明；
+// 另外提供完成式的multishot accept、使用provided buffer的multishot recv
+// 和send。所有SQE先放在提交队列里，下一次poll时与等待合并为一次io_uring_enter。
+// 非线程安全，只能在所属EpollManager的线程中使用。
+class UringPoller : public Poller {
+  public:
+    // fd < 0 时为 -errno，这时multishot accept已经被内核终止，不会自动
+    // 重新提交，由调用方决定何时再调用acceptMultishot
+    using AcceptCallback = std::function<void(int fd)>;
+    // len == 0 表示对端关闭，len < 0 为 -errno；data只在回调期间有效
+    using RecvCallback = std::function<void(const char *data, int len)>;
+    using SendCallback = std::function<void(int res)>;
+
+    // 默认大小，按几百个并发连接估算，与epoll每轮的事件数无关。
+    // SQ只放一轮事件循环里新提交的请求；provided buffer由所有连接的
+    // multishot recv共用，太少时recv会反复拿到-ENOBUFS
+    static const unsigned kDefaultEntries = 256;
+    static const unsigned kDefaultBufferCount = 1024;
+    static const unsigned kDefaultBufferSize = 4096;
+
+    // CQ的大小是entries的4倍
+    UringPoller(unsigned entries, unsigned buffer_count, unsigned buffer_size);
+    ~UringPoller();
+
+    void add(int fd, uint32_t events, uint64_t token) override;
+    void modify(int fd, uint32_t events, uint64_t token) override;
+    void remove(int fd) override;
+    void poll(int timeout, std::vector<PollEvent> &active) override;
+
+    void acceptMultishot(int listen_fd, AcceptCallback cb);
+    void recvMultishot(int fd, RecvCallback cb);
+    // data在cb被调用前必须保持有效
+    void send(int fd, const char *data, size_t len, SendCallback cb);
+    // 取消fd上的accept/recv，之后不会再回调，调用后即可close(fd)；
+    // 可以在回调中调用
+    void cancel(int fd);
+
+  private:
+    // multishot请求一次提交会产生很多完成事件，CQ比SQ大
+    static const unsigned kCqMultiplier = 4;
+
+    enum OpType : uint64_t { kPoll = 1, kAccept, kRecv, kSend, kCancel };
+
+    struct Op {
+        OpType type;
+        int fd;
+        bool active;    // 为false时完成事件只做清理，不再回调
+        bool in_flight; // 内核中是否还有这个请求
+        int next_free;
+        AcceptCallback accept_cb;
+        RecvCallback recv_cb;
+        SendCallback send_cb;
+    };
+
+    struct PollEntry {
+        uint64_t token;
+        uint32_t events;
+        uint32_t seq; // 每次重新注册加一，用来丢弃旧请求的完成事件
+        bool active;
+    };
+
+    struct io_uring_sqe *getSqe();
+    void enter(bool wait, int timeout);
+    void handleCompletion(const struct io_uring_cqe &cqe,
+                          std::vector<PollEvent> &active);
+    void handlePoll(const struct io_uring_cqe &cqe,
+                    std::vector<PollEvent> &active);
+    void handleAccept(const struct io_uring_cqe &cqe);
+    void handleRecv(const struct io_uring_cqe &cqe);
+    void handleSend(const struct io_uring_cqe &cqe);
+    void preparePoll(int fd);
+    void preparePollRemove(int fd);
+    void prepareAccept(int index);
+    void prepareRecv(int index);
+    void prepareCancel(uint64_t user_data);
+    int allocOp(OpType type, int fd);
+    void freeOp(int index);
+    void setupBufferRing();
+    void recycleBuffer(uint16_t bid);
+    uint64_t pollUserData(int fd) const;
+
+    int ring_fd;
+    struct io_uring_params params;
+
+    void *sq_ptr;
+    size_t sq_ring_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_flags;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned sqe_tail; // 本地已填写的SQE位置，enter时一次性发布
+
+    void *cq_ptr;
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    unsigned buffer_count;
+    unsigned buffer_size;
+    uint16_t buf_tail;
+    char *buffers;
+
+    std::vector<PollEntry> polls; // 以fd为下标
+    std::vector<int> fd_ops;      // 以fd为下标，fd上的accept/recv请求
+    std::vector<Op> ops;
+    int free_op;
+};
+
+#endif // URINGPOLLER_H
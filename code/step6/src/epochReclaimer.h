@@ -0,0 +1,205 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// 基于epoch的内存回收（EBR）。无锁结构里摘下来的节点可能还有别的线程
+// 正在读，不能立刻释放，先retire到当前线程的列表里，等所有线程都离开
+// 可能看到它的临界区以后再回收。
+// 用法：访问共享节点前在栈上放一个EpochReclaimer::Guard，
+// 把节点从结构上摘下来以后调用retire(ptr, reclaim)。
+// 全局epoch只有在所有处于临界区的线程都已经看到当前值时才能加一，
+// 因此在epoch e retire的节点，全局epoch到达e+2时已经没有线程能访问它。
+// 每个线程retire满kCollectThreshold个节点尝试推进一次epoch并回收。
+class EpochReclaimer {
+  public:
+    using Reclaim = void (*)(void *);
+
+    class Guard {
+      public:
+        Guard() { enter(); }
+        ~Guard() { leave(); }
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+    };
+
+    // ptr已经不能再从共享结构上找到，安全时调用reclaim(ptr)
+    static void retire(void *ptr, Reclaim reclaim);
+
+  private:
+    static const size_t kMaxThreads = 256;
+    static const size_t kCollectThreshold = 64;
+
+    // 每个线程一个槽位，epoch为0表示不在临界区
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch;
+        std::atomic<bool> used;
+    };
+
+    struct Retired {
+        void *ptr;
+        Reclaim reclaim;
+        uint64_t epoch;
+    };
+
+    struct ThreadState {
+        ThreadState();
+        ~ThreadState();
+
+        Slot *slot;
+        unsigned depth; // Guard可以嵌套，只有最外层进出临界区
+        size_t since_collect;
+        std::vector<Retired> retired;
+    };
+
+    // 退出的线程还没回收的节点交给其他线程；
+    // 进程退出时已经没有线程在访问，剩下的直接回收
+    struct Orphans {
+        ~Orphans() {
+            for (Retired &r : retired)
+                r.reclaim(r.ptr);
+        }
+
+        std::mutex mutex;
+        std::vector<Retired> retired;
+        std::atomic<bool> pending;
+    };
+
+    static void enter();
+    static void leave();
+    static void tryAdvance();
+    static void collect(ThreadState &state);
+
+    static std::atomic<uint64_t> &globalEpoch();
+    static Slot *slots();
+    static std::atomic<size_t> &slotCount();
+    static Orphans &orphans();
+    static ThreadState &threadState();
+};
+
+inline std::atomic<uint64_t> &EpochReclaimer::globalEpoch() {
+    static std::atomic<uint64_t> epoch(1);
+    return epoch;
+}
+
+inline EpochReclaimer::Slot *EpochReclaimer::slots() {
+    static Slot slots[kMaxThreads]; // 静态存储，初始全为0
+    return slots;
+}
+
+// 用过的槽位数量的上界，推进epoch时只扫描这么多
+inline std::atomic<size_t> &EpochReclaimer::slotCount() {
+    static std::atomic<size_t> count(0);
+    return count;
+}
+
+inline EpochReclaimer::Orphans &EpochReclaimer::orphans() {
+    static Orphans orphans;
+    return orphans;
+}
+
+inline EpochReclaimer::ThreadState &EpochReclaimer::threadState() {
+    static thread_local ThreadState state;
+    return state;
+}
+
+inline EpochReclaimer::ThreadState::ThreadState()
+    : slot(nullptr), depth(0), since_collect(0) {
+    Slot *all = slots();
+    size_t index = 0;
+    while (slot == nullptr) {
+        for (index = 0; index < kMaxThreads; ++index) {
+            bool expected = false;
+            if (!all[index].used.load(std::memory_order_relaxed) &&
+                all[index].used.compare_exchange_strong(expected, true)) {
+                slot = &all[index];
+                break;
+            }
+        }
+        // 槽位用完说明线程数超过kMaxThreads，等其他线程退出
+    }
+    size_t count = slotCount().load();
+    while (count < index + 1 &&
+           !slotCount().compare_exchange_weak(count, index + 1)) {
+    }
+}
+
+// 退出前推进两次epoch，没有其他线程停在旧epoch时可以全部回收
+inline EpochReclaimer::ThreadState::~ThreadState() {
+    for (int i = 0; i < 2 && !retired.empty(); ++i) {
+        tryAdvance();
+        collect(*this);
+    }
+    if (!retired.empty()) {
+        Orphans &o = orphans();
+        std::lock_guard<std::mutex> lock(o.mutex);
+        o.retired.insert(o.retired.end(), retired.begin(), retired.end());
+        o.pending.store(true);
+    }
+    slot->epoch.store(0);
+    slot->used.store(false);
+}
+
+inline void EpochReclaimer::enter() {
+    ThreadState &state = threadState();
+    if (state.depth++ == 0) {
+        state.slot->epoch.store(globalEpoch().load(),
+                                std::memory_order_relaxed);
+        // 先公布自己的epoch再读共享节点
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+inline void EpochReclaimer::leave() {
+    ThreadState &state = threadState();
+    if (--state.depth == 0) {
+        state.slot->epoch.store(0, std::memory_order_release);
+    }
+}
+
+inline void EpochReclaimer::retire(void *ptr, Reclaim reclaim) {
+    ThreadState &state = threadState();
+    state.retired.push_back(Retired{ptr, reclaim, globalEpoch().load()});
+    if (++state.since_collect >= kCollectThreshold) {
+        state.since_collect = 0;
+        tryAdvance();
+        collect(state);
+    }
+}
+
+// 所有在临界区的线程都看到了当前epoch时把它加一
+inline void EpochReclaimer::tryAdvance() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t epoch = globalEpoch().load();
+    Slot *all = slots();
+    size_t count = slotCount().load();
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t local = all[i].epoch.load();
+        if (local != 0 && local != epoch)
+            return;
+    }
+    globalEpoch().compare_exchange_strong(epoch, epoch + 1);
+}
+
+inline void EpochReclaimer::collect(ThreadState &state) {
+    std::vector<Retired> &retired = state.retired;
+    // 接手的节点放在前面，它们一般比本线程的旧
+    Orphans &o = orphans();
+    if (o.pending.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(o.mutex);
+        retired.insert(retired.begin(), o.retired.begin(), o.retired.end());
+        o.retired.clear();
+        o.pending.store(false);
+    }
+    // 本线程retire时的epoch不减，只回收可以回收的前缀，
+    // epoch推进不了时不用反复扫描整个列表
+    uint64_t epoch = globalEpoch().load();
+    size_t n = 0;
+    while (n < retired.size() && retired[n].epoch + 2 <= epoch) {
+        retired[n].reclaim(retired[n].ptr);
+        ++n;
+    }
+    retired.erase(retired.begin(), retired.begin() + n);
+}
@@ -1,49 +1,58 @@
+#pragma once
+#include "epochReclaimer.h"
+#include "nodePool.h"
 #include <atomic>
-#include <chrono>
 #include <memory>
-#include <thread>
+#include <new>
 
+// 无界多生产者多消费者链表队列，head指向哑节点。
+// 出队摘下的旧head可能还有并发的dequeue在读它的next，
+// 交给EpochReclaimer等安全后再析构，内存放回NodePool复用。
+// enqueue不需要进临界区：只有设置了prevTail->next的生产者自己
+// 才能让prevTail被摘下，它在设置之前prevTail一定还在。
 template <typename T> class LockFreeQueue {
   public:
     LockFreeQueue() {
-        Node *node = new Node();
+        Node *node = new (NodePool<Node>::allocate()) Node();
         head.store(node);
         tail.store(node);
     }
 
+    // 析构时没有其他线程访问队列，剩下的节点直接回收
     ~LockFreeQueue() {
         while (Node *node = head.load()) {
             head.store(node->next);
-            delete node;
+            reclaim(node);
         }
     }
 
     void enqueue(T value) {
-        Node *node = new Node(std::move(value));
+        Node *node = new (NodePool<Node>::allocate()) Node(std::move(value));
         Node *prevTail = tail.exchange(node);
         prevTail->next.store(node, std::memory_order_release);
     }
 
+    // 队列为空时立即返回false，由调用方决定是自旋还是睡眠
     bool dequeue(T &result) {
-        int spin_count = 1000; // 设定最大自旋次数
+        EpochReclaimer::Guard guard;
         Node *node;
+        Node *next;
         do {
             node = head.load();
-            Node *next = node->next.load(std::memory_order_acquire);
+            next = node->next.load(std::memory_order_acquire);
             if (next == nullptr) {
-                // 自旋超过最大次数后休眠一段时间
-                if (--spin_count <= 0) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                    spin_count = 1000; // 重置自旋计数
-                }
-                continue;
+                return false;
             }
-            if (head.compare_exchange_weak(node, next)) {
-                result = std::move(next->value);
-                delete node; // 应该删除 next 节点而不是 node
-                return true;
-            }
-        } while (true);
+        } while (!head.compare_exchange_weak(node, next));
+        // next成为新的哑节点，只有抢到它的线程会读它的值
+        result = std::move(next->value);
+        EpochReclaimer::retire(node, &LockFreeQueue::reclaim);
+        return true;
+    }
+
+    bool empty() const {
+        EpochReclaimer::Guard guard;
+        return head.load()->next.load(std::memory_order_acquire) == nullptr;
     }
 
   private:
@@ -55,6 +64,12 @@ template <typename T> class LockFreeQueue {
         Node(T val) : value(std::move(val)), next(nullptr) {}
     };
 
+    static void reclaim(void *ptr) {
+        Node *node = static_cast<Node *>(ptr);
+        node->~Node();
+        NodePool<Node>::release(node);
+    }
+
     std::atomic<Node *> head;
     std::atomic<Node *> tail;
 };
@@ -0,0 +1,187 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// 有界多生产者多消费者环形队列，算法来自Dmitry Vyukov的
+// "Bounded MPMC queue"。容量向上取整为2的幂，所有槽位在构造时一次分配，
+// 入队出队都不再申请内存。
+// 每个槽位带一个序号：序号等于pos说明槽位空闲，可以写入第pos个元素；
+// 等于pos+1说明第pos个元素已经写好，可以读取。生产者和消费者各自在
+// enqueue_pos/dequeue_pos上CAS抢位置，抢到之后只访问自己的槽位。
+// 队列满或空时try_*立即返回false，由调用方决定自旋还是睡眠。
+template <typename T> class MPMCQueue {
+  public:
+    explicit MPMCQueue(size_t capacity = 1024);
+    ~MPMCQueue();
+    MPMCQueue(const MPMCQueue &) = delete;
+    MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+    // 入队失败时value保持原样，调用方可以重试
+    bool try_enqueue(const T &value) { return emplace(value); }
+    bool try_enqueue(T &&value) { return emplace(std::move(value)); }
+    bool try_dequeue(T &result);
+
+    // 批量版本一次CAS占住一段连续位置，返回实际入队/出队的个数，
+    // 可能小于count；入队时前若干个元素被移走
+    template <typename It> size_t try_enqueue_bulk(It first, size_t count);
+    template <typename It> size_t try_dequeue_bulk(It out, size_t max_count);
+
+    // 没有被占住的位置时返回true；有生产者正在写的元素也算不空
+    bool empty() const;
+    size_t capacity() const { return mask + 1; }
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        T *value() { return reinterpret_cast<T *>(&storage); }
+    };
+
+    static const size_t kCacheLine = 64;
+
+    static size_t round_up(size_t capacity);
+    template <typename U> bool emplace(U &&value);
+    // 从pos开始连续多少个槽位的序号等于pos+i+offset，最多max_count个
+    size_t count_ready(size_t pos, size_t offset, size_t max_count) const;
+
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    // 生产者和消费者分别修改的位置放在不同的cache line上
+    alignas(kCacheLine) std::atomic<size_t> enqueue_pos;
+    alignas(kCacheLine) std::atomic<size_t> dequeue_pos;
+};
+
+template <typename T> size_t MPMCQueue<T>::round_up(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+    return size;
+}
+
+template <typename T>
+MPMCQueue<T>::MPMCQueue(size_t capacity)
+    : mask(round_up(capacity) - 1), cells(new Cell[mask + 1]),
+      enqueue_pos(0), dequeue_pos(0) {
+    for (size_t i = 0; i <= mask; ++i)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+// 析构时没有其他线程访问，直接销毁还没被取走的元素
+template <typename T> MPMCQueue<T>::~MPMCQueue() {
+    size_t end = enqueue_pos.load(std::memory_order_relaxed);
+    for (size_t pos = dequeue_pos.load(std::memory_order_relaxed); pos != end;
+         ++pos)
+        cells[pos & mask].value()->~T();
+}
+
+template <typename T>
+template <typename U>
+bool MPMCQueue<T>::emplace(U &&value) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff =
+            static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false; // 槽位还没被消费者读走，队列满
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    new (cell->value()) T(std::forward<U>(value));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T> bool MPMCQueue<T>::try_dequeue(T &result) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff =
+            static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false; // 槽位还没写好，队列空
+        } else {
+            pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    result = std::move(*cell->value());
+    cell->value()->~T();
+    cell->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+size_t MPMCQueue<T>::count_ready(size_t pos, size_t offset,
+                                 size_t max_count) const {
+    size_t n = 0;
+    while (n < max_count &&
+           cells[(pos + n) & mask].sequence.load(std::memory_order_acquire) ==
+               pos + n + offset)
+        ++n;
+    return n;
+}
+
+// 序号只会往前走，CAS成功时enqueue_pos仍是pos，
+// 之前数出来的n个空闲槽位不会被别的生产者占走
+template <typename T>
+template <typename It>
+size_t MPMCQueue<T>::try_enqueue_bulk(It first, size_t count) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    size_t n;
+    do {
+        n = count_ready(pos, 0, count);
+        if (n == 0)
+            return 0;
+    } while (!enqueue_pos.compare_exchange_weak(pos, pos + n,
+                                                std::memory_order_relaxed));
+    for (size_t i = 0; i < n; ++i, ++first) {
+        Cell &cell = cells[(pos + i) & mask];
+        new (cell.value()) T(std::move(*first));
+        cell.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return n;
+}
+
+template <typename T>
+template <typename It>
+size_t MPMCQueue<T>::try_dequeue_bulk(It out, size_t max_count) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    size_t n;
+    do {
+        n = count_ready(pos, 1, max_count);
+        if (n == 0)
+            return 0;
+    } while (!dequeue_pos.compare_exchange_weak(pos, pos + n,
+                                                std::memory_order_relaxed));
+    for (size_t i = 0; i < n; ++i, ++out) {
+        Cell &cell = cells[(pos + i) & mask];
+        *out = std::move(*cell.value());
+        cell.value()->~T();
+        cell.sequence.store(pos + i + mask + 1, std::memory_order_release);
+    }
+    return n;
+}
+
+template <typename T> bool MPMCQueue<T>::empty() const {
+    return enqueue_pos.load(std::memory_order_acquire) ==
+           dequeue_pos.load(std::memory_order_acquire);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// 固定大小节点的空闲链表，避免无锁结构每个节点都走全局new/delete。
+// 每个线程缓存一批回收的内存块，分配时先从本线程取；
+// 生产者分配、消费者回收时两边不平衡，多出来的块按kBatch个一批
+// 放进全局仓库，缺块的线程从仓库整批取，锁的开销分摊到kBatch个节点上。
+// 只管理内存，构造和析构由调用方负责。
+template <typename Node> class NodePool {
+  public:
+    static void *allocate();
+    static void release(void *block);
+
+  private:
+    static const size_t kBatch = 64;
+    static const size_t kMaxDepotBlocks = 64 * 1024;
+
+    struct Depot {
+        ~Depot() {
+            for (void *block : blocks)
+                ::operator delete(block);
+        }
+
+        std::mutex mutex;
+        std::vector<void *> blocks;
+    };
+
+    // 线程退出时把缓存的块还给仓库
+    struct Cache {
+        ~Cache() {
+            destroyed() = true;
+            giveBack(blocks, blocks.size());
+        }
+
+        std::vector<void *> blocks;
+    };
+
+    // 把blocks末尾的n个块放进仓库，仓库满了直接释放
+    static void giveBack(std::vector<void *> &blocks, size_t n);
+    static Depot &depot();
+    static Cache &cache();
+    // 本线程的Cache是否已经析构，线程退出过程中还可能有节点被回收
+    static bool &destroyed();
+};
+
+template <typename Node>
+typename NodePool<Node>::Depot &NodePool<Node>::depot() {
+    static Depot depot;
+    return depot;
+}
+
+template <typename Node>
+typename NodePool<Node>::Cache &NodePool<Node>::cache() {
+    static thread_local Cache cache;
+    return cache;
+}
+
+template <typename Node> bool &NodePool<Node>::destroyed() {
+    static thread_local bool destroyed = false;
+    return destroyed;
+}
+
+template <typename Node> void *NodePool<Node>::allocate() {
+    std::vector<void *> &blocks = cache().blocks;
+    if (blocks.empty()) {
+        Depot &d = depot();
+        std::lock_guard<std::mutex> lock(d.mutex);
+        size_t n = d.blocks.size() < kBatch ? d.blocks.size() : kBatch;
+        blocks.insert(blocks.end(), d.blocks.end() - n, d.blocks.end());
+        d.blocks.resize(d.blocks.size() - n);
+    }
+    if (blocks.empty())
+        return ::operator new(sizeof(Node));
+    void *block = blocks.back();
+    blocks.pop_back();
+    return block;
+}
+
+template <typename Node> void NodePool<Node>::release(void *block) {
+    if (destroyed()) {
+        ::operator delete(block);
+        return;
+    }
+    std::vector<void *> &blocks = cache().blocks;
+    blocks.push_back(block);
+    if (blocks.size() >= 2 * kBatch)
+        giveBack(blocks, kBatch);
+}
+
+template <typename Node>
+void NodePool<Node>::giveBack(std::vector<void *> &blocks, size_t n) {
+    Depot &d = depot();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    for (size_t i = 0; i < n; ++i) {
+        if (d.blocks.size() < kMaxDepotBlocks)
+            d.blocks.push_back(blocks.back());
+        else
+            ::operator delete(blocks.back());
+        blocks.pop_back();
+    }
+}
@@ -0,0 +1,206 @@
+#include "lockFreeQueue.h"
+#include "mpmcQueue.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/lockfree/queue.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// 队列吞吐测试：producers个线程一共放入items个整数，consumers个线程取出，
+// 统计从开始放入到全部取出的吞吐，并校验取出的总和。
+// lockfree：LockFreeQueue，每次入队new一个节点；
+// boost：boost::lockfree::queue，预分配capacity个节点；
+// mpmc：MPMCQueue逐个入队出队；
+// mpmc_bulk：MPMCQueue每次批量入队出队kBatch个。
+// 有界队列满或空时让出CPU重试。
+class QueueBench {
+  public:
+    QueueBench(int producers, int consumers, long items, size_t capacity);
+    void run();
+
+  private:
+    static const size_t kBatch = 32;
+
+    template <class Queue> void run_mode(const char *mode, Queue &queue);
+    template <class Queue> void produce(Queue &queue, long first, long last);
+    template <class Queue> void consume(Queue &queue);
+
+    static bool push(LockFreeQueue<long> &queue, long value);
+    static bool push(boost::lockfree::queue<long> &queue, long value);
+    static bool push(MPMCQueue<long> &queue, long value);
+    static bool pop(LockFreeQueue<long> &queue, long &value);
+    static bool pop(boost::lockfree::queue<long> &queue, long &value);
+    static bool pop(MPMCQueue<long> &queue, long &value);
+
+    int producers;
+    int consumers;
+    long items;
+    size_t capacity;
+    bool bulk;
+    std::atomic<long> consumed;
+    std::atomic<long> sum;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+QueueBench::QueueBench(int producers, int consumers, long items,
+                       size_t capacity)
+    : producers(producers), consumers(consumers), items(items),
+      capacity(capacity), bulk(false), consumed(0), sum(0) {
+    logger = spdlog::stdout_color_mt("queue_bench");
+}
+
+bool QueueBench::push(LockFreeQueue<long> &queue, long value) {
+    queue.enqueue(value);
+    return true;
+}
+
+bool QueueBench::push(boost::lockfree::queue<long> &queue, long value) {
+    return queue.push(value);
+}
+
+bool QueueBench::push(MPMCQueue<long> &queue, long value) {
+    return queue.try_enqueue(value);
+}
+
+bool QueueBench::pop(LockFreeQueue<long> &queue, long &value) {
+    return queue.dequeue(value);
+}
+
+bool QueueBench::pop(boost::lockfree::queue<long> &queue, long &value) {
+    return queue.pop(value);
+}
+
+bool QueueBench::pop(MPMCQueue<long> &queue, long &value) {
+    return queue.try_dequeue(value);
+}
+
+template <class Queue>
+void QueueBench::produce(Queue &queue, long first, long last) {
+    for (long i = first; i < last; ++i) {
+        while (!push(queue, i)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// MPMCQueue的批量版本
+template <>
+void QueueBench::produce(MPMCQueue<long> &queue, long first, long last) {
+    if (!bulk) {
+        for (long i = first; i < last; ++i) {
+            while (!queue.try_enqueue(i)) {
+                std::this_thread::yield();
+            }
+        }
+        return;
+    }
+    long batch[kBatch];
+    while (first < last) {
+        size_t n = std::min<long>(kBatch, last - first);
+        for (size_t i = 0; i < n; ++i)
+            batch[i] = first + i;
+        size_t done = 0;
+        while (done < n) {
+            size_t pushed = queue.try_enqueue_bulk(batch + done, n - done);
+            if (pushed == 0)
+                std::this_thread::yield();
+            done += pushed;
+        }
+        first += n;
+    }
+}
+
+template <class Queue> void QueueBench::consume(Queue &queue) {
+    long local_sum = 0;
+    long value;
+    while (consumed.load(std::memory_order_relaxed) < items) {
+        if (pop(queue, value)) {
+            local_sum += value;
+            consumed.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    sum.fetch_add(local_sum);
+}
+
+template <> void QueueBench::consume(MPMCQueue<long> &queue) {
+    long local_sum = 0;
+    long batch[kBatch];
+    while (consumed.load(std::memory_order_relaxed) < items) {
+        size_t n = bulk ? queue.try_dequeue_bulk(batch, kBatch)
+                        : queue.try_dequeue(batch[0]);
+        if (n == 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < n; ++i)
+            local_sum += batch[i];
+        consumed.fetch_add(n, std::memory_order_relaxed);
+    }
+    sum.fetch_add(local_sum);
+}
+
+template <class Queue>
+void QueueBench::run_mode(const char *mode, Queue &queue) {
+    consumed.store(0);
+    sum.store(0);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < consumers; ++i) {
+        threads.emplace_back([this, &queue]() { consume(queue); });
+    }
+    for (int i = 0; i < producers; ++i) {
+        long first = items * i / producers;
+        long last = items * (i + 1) / producers;
+        threads.emplace_back(
+            [this, &queue, first, last]() { produce(queue, first, last); });
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    long expected = items * (items - 1) / 2;
+    logger->info("{:9}: {:.2f} M items/s{}", mode, items / seconds / 1e6,
+                 sum.load() == expected ? "" : " (checksum mismatch)");
+}
+
+void QueueBench::run() {
+    logger->info("{} producers, {} consumers, {} items, capacity {}",
+                 producers, consumers, items, capacity);
+    {
+        LockFreeQueue<long> queue;
+        run_mode("lockfree", queue);
+    }
+    {
+        boost::lockfree::queue<long> queue(capacity);
+        run_mode("boost", queue);
+    }
+    {
+        MPMCQueue<long> queue(capacity);
+        bulk = false;
+        run_mode("mpmc", queue);
+    }
+    {
+        MPMCQueue<long> queue(capacity);
+        bulk = true;
+        run_mode("mpmc_bulk", queue);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int producers = argc > 1 ? atoi(argv[1]) : 2;
+    int consumers = argc > 2 ? atoi(argv[2]) : 2;
+    long items = argc > 3 ? atol(argv[3]) : 2000000;
+    size_t capacity = argc > 4 ? atol(argv[4]) : 1024;
+
+    QueueBench bench(producers, consumers, items, capacity);
+    bench.run();
+    return 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
-#include "lockFreeQueue.h"
+#include "eventCount.h"
+#include "mpmcQueue.h"
 #include <atomic>
 #include <condition_variable>
 #include <functional>
@@ -21,20 +22,29 @@ class ThreadPool {
     auto enqueue(F &&f, Args &&...args) -> std::future<decltype(f(args...))>;
 
   private:
+    // 队列空了以后先自旋的轮数，之后在idle上睡眠
+    static const int kSpinRounds = 64;
+    // 任务队列的容量，满了以后enqueue等工作线程取走任务
+    static const size_t kQueueCapacity = 1024;
+
     // 线程需要执行的工作函数
     void worker_thread();
 
     // 线程池中的工作线程
     std::vector<std::thread> workers;
 
-    // 任务队列
-    LockFreeQueue<std::function<void()>> tasks;
+    // 任务队列，有界环形队列，入队出队不申请内存
+    MPMCQueue<std::function<void()>> tasks;
 
     std::atomic<bool> stop;
+
+    // 空闲工作线程在这里睡眠，enqueue有睡眠的线程时才唤醒一个
+    EventCount idle;
 };
 
 // 构造函数，启动指定数量的工作线程
-inline ThreadPool::ThreadPool(size_t num_threads) : stop(false) {
+inline ThreadPool::ThreadPool(size_t num_threads)
+    : tasks(kQueueCapacity), stop(false) {
     for (size_t i = 0; i < num_threads; ++i)
         workers.emplace_back([this] { worker_thread(); });
 }
@@ -42,6 +52,7 @@ inline ThreadPool::ThreadPool(size_t num_threads) : stop(false) {
 // 析构函数，等待所有线程完成后销毁线程池
 inline ThreadPool::~ThreadPool() {
     stop.store(true);
+    idle.notifyAll();
     for (std::thread &worker : workers)
         worker.join();
 }
@@ -58,20 +69,35 @@ auto ThreadPool::enqueue(F &&f,
     std::future<return_type> res = task->get_future();
 
     // 向队列中添加任务
-    tasks.enqueue([task]() { (*task)(); });
+    std::function<void()> wrapped_task([task]() { (*task)(); });
+    while (!tasks.try_enqueue(std::move(wrapped_task))) {
+        std::this_thread::yield();
+    }
+    idle.notifyOne();
     return res;
 }
 
-// 工作线程函数，从队列中取出任务并执行
+// 工作线程函数，从队列中取出任务并执行；
+// 队列空了先让出CPU自旋几轮，还是没有任务就睡眠，空闲时不占CPU
 inline void ThreadPool::worker_thread() {
-    while (true) {
-        while (!stop.load()) {
-            std::function<void()> task;
-            if (tasks.dequeue(task)) {
-                task();
+    int spins = 0;
+    while (!stop.load()) {
+        std::function<void()> task;
+        if (tasks.try_dequeue(task)) {
+            task();
+            spins = 0;
+        } else if (spins < kSpinRounds) {
+            ++spins;
+            std::this_thread::yield(); // Prevent busy waiting
+        } else {
+            // 登记为等待者之后再检查一次，这之间enqueue的任务不会漏掉
+            EventCount::Key key = idle.prepareWait();
+            if (!tasks.empty() || stop.load()) {
+                idle.cancelWait();
             } else {
-                std::this_thread::yield(); // Prevent busy waiting
+                idle.wait(key);
             }
+            spins = 0;
         }
     }
 }
@@ -2,15 +2,23 @@
 #include "spdlog/spdlog.h"
 #include "threadPool.h"
 #include <arpa/inet.h>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <iostream>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #define MAX_EVENTS 10
+// 客户端fd注册的事件。EPOLLONESHOT保证一次事件只交给一个工作线程，
+// 同一个fd不会被两个线程同时读；handle_client读完以后再重新打开
+#define CLIENT_EVENTS (EPOLLIN | EPOLLET | EPOLLONESHOT)
+// 发送缓冲区满时等待可写的最长时间（毫秒），超过就当作发送失败
+#define SEND_TIMEOUT_MS 5000
 
 class Server {
   public:
@@ -22,6 +30,7 @@ class Server {
   private:
     void init();
     void handle_client(int client_socket);
+    bool send_all(int client_socket, const std::string &data);
 
     int server_fd;
     int port;
@@ -98,6 +107,9 @@ void Server::init() {
 
 void Server::run() {
     struct epoll_event events[MAX_EVENTS];
+    // 一次epoll_wait里可读的客户端攒成一批交给线程池
+    std::vector<std::function<void()>> batch;
+    batch.reserve(MAX_EVENTS);
     while (true) {
         int num_fds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
         if (num_fds == -1) {
@@ -118,8 +130,12 @@ void Server::run() {
                              inet_ntoa(address.sin_addr),
                              ntohs(address.sin_port));
 
+                // 非阻塞读，handle_client读到EAGAIN就返回
+                int flags = fcntl(new_socket, F_GETFL, 0);
+                fcntl(new_socket, F_SETFL, flags | O_NONBLOCK);
+
                 struct epoll_event event;
-                event.events = EPOLLIN | EPOLLET;
+                event.events = CLIENT_EVENTS;
                 event.data.fd = new_socket;
                 if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, new_socket, &event) ==
                     -1) {
@@ -129,17 +145,35 @@ void Server::run() {
             } else {
                 // 处理已连接客户端的数据
                 int client_socket = events[i].data.fd;
-                thread_pool.enqueue(
+                batch.emplace_back(
                     [this, client_socket]() { handle_client(client_socket); });
             }
         }
+        if (!batch.empty()) {
+            thread_pool.enqueue_bulk(batch.begin(), batch.end());
+            batch.clear();
+        }
     }
 }
 
+// 读完当前所有数据后重新打开EPOLLONESHOT，等下一次可读
 void Server::handle_client(int client_socket) {
-    char buffer[buffer_size] = {0};
+    char buffer[buffer_size];
     while (true) {
-        int valread = read(client_socket, buffer, buffer_size);
+        ssize_t valread = read(client_socket, buffer, buffer_size - 1);
+        if (valread < 0 && errno == EINTR)
+            continue;
+        if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct epoll_event event;
+            event.events = CLIENT_EVENTS;
+            event.data.fd = client_socket;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_socket, &event) ==
+                -1) {
+                logger->error("epoll_ctl failed");
+                close(client_socket);
+            }
+            return;
+        }
         if (valread <= 0) {
             if (valread == 0) {
                 logger->info("Client disconnected");
@@ -147,7 +181,7 @@ void Server::handle_client(int client_socket) {
                 logger->error("read error");
             }
             close(client_socket);
-            break;
+            return;
         }
 
         buffer[valread] = '\0'; // 确保缓冲区以空字符结尾
@@ -155,20 +189,46 @@ void Server::handle_client(int client_socket) {
         // 发送响应
         std::string response = "server: ";
         response.append(buffer);
-        send(client_socket, response.c_str(), response.length(), 0);
+        if (!send_all(client_socket, response)) {
+            logger->error("send failed, closing connection");
+            close(client_socket);
+            return;
+        }
         logger->info("Sent data: {}", response);
 
         // 检查退出条件
         if (strcmp(buffer, "exit") == 0) {
             logger->info("Received exit message, closing connection");
             close(client_socket);
-            break;
+            return;
         }
+    }
+}
 
-        // 清空缓冲区
-        memset(buffer, 0, buffer_size);
+// 非阻塞socket上send可能只写出一部分，也可能返回EAGAIN，
+// 循环写到全部发完；发送缓冲区满时用poll等到可写再继续
+bool Server::send_all(int client_socket, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(client_socket, data.data() + sent, data.size() - sent,
+                         MSG_NOSIGNAL);
+        if (n >= 0) {
+            sent += static_cast<size_t>(n);
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return false;
+        struct pollfd pfd;
+        pfd.fd = client_socket;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, SEND_TIMEOUT_MS);
+        if (ready == 0 || (ready < 0 && errno != EINTR))
+            return false;
     }
-    close(client_socket);
+    return true;
 }
 
 int main() {
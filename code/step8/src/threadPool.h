@@ -1,5 +1,6 @@
 #pragma once
 #include <atomic>
+#include "eventCount.h"
 #include <boost/lockfree/queue.hpp>
 #include <functional>
 #include <future>
@@ -17,7 +18,17 @@ class ThreadPool {
     template <class F, class... Args>
     auto enqueue(F &&f, Args &&...args) -> std::future<decltype(f(args...))>;
 
+    // 一次添加多个任务，[first, last)中每个元素是无参数的可调用对象。
+    // boost::lockfree::queue没有批量入队，仍然逐个push，
+    // 但整批只唤醒一次等待的工作线程
+    template <class It>
+    auto enqueue_bulk(It first, It last)
+        -> std::vector<std::future<decltype((*first)())>>;
+
   private:
+    // 队列空了以后先自旋的轮数，之后在idle上睡眠
+    static const int kSpinRounds = 64;
+
     // 线程需要执行的工作函数
     void worker_thread();
 
@@ -28,6 +39,9 @@ class ThreadPool {
     boost::lockfree::queue<std::function<void()> *> tasks;
 
     std::atomic<bool> stop;
+
+    // 空闲工作线程在这里睡眠，enqueue有睡眠的线程时才唤醒一个
+    EventCount idle;
 };
 
 // 构造函数，启动指定数量的工作线程
@@ -39,6 +53,7 @@ inline ThreadPool::ThreadPool(size_t num_threads) : tasks(128), stop(false) {
 // 析构函数，等待所有线程完成后销毁线程池
 inline ThreadPool::~ThreadPool() {
     stop.store(true);
+    idle.notifyAll();
     for (std::thread &worker : workers)
         worker.join();
 
@@ -64,18 +79,50 @@ auto ThreadPool::enqueue(F &&f,
     auto wrapped_task = new std::function<void()>([task]() { (*task)(); });
     while (!tasks.push(wrapped_task)) {
     }
+    idle.notifyOne();
+    return res;
+}
+
+template <class It>
+auto ThreadPool::enqueue_bulk(It first, It last)
+    -> std::vector<std::future<decltype((*first)())>> {
+    using return_type = decltype((*first)());
+    std::vector<std::future<return_type>> res;
+    for (; first != last; ++first) {
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+            std::move(*first));
+        res.push_back(task->get_future());
+        auto wrapped_task =
+            new std::function<void()>([task]() { (*task)(); });
+        while (!tasks.push(wrapped_task)) {
+        }
+    }
+    idle.notify(static_cast<int>(res.size()));
     return res;
 }
 
-// 工作线程函数，从队列中取出任务并执行
+// 工作线程函数，从队列中取出任务并执行；
+// 队列空了先让出CPU自旋几轮，还是没有任务就睡眠，空闲时不占CPU
 inline void ThreadPool::worker_thread() {
+    int spins = 0;
     while (!stop.load()) {
         std::function<void()> *task;
         if (tasks.pop(task)) {
             (*task)();
             delete task;
-        } else {
+            spins = 0;
+        } else if (spins < kSpinRounds) {
+            ++spins;
             std::this_thread::yield(); // 防止 busy waiting
+        } else {
+            // 登记为等待者之后再检查一次，这之间enqueue的任务不会漏掉
+            EventCount::Key key = idle.prepareWait();
+            if (!tasks.empty() || stop.load()) {
+                idle.cancelWait();
+            } else {
+                idle.wait(key);
+            }
+            spins = 0;
         }
     }
 }
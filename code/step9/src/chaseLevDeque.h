@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Chase-Lev工作窃取双端队列，内存序按 Lê et al. "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (PPoPP'13)。
+// 只有所属线程可以push/pop，在bottom一端后进先出；
+// 其他线程用steal从top一端先进先出地偷取，彼此之间只在top上CAS。
+// 元素必须是指针，队列不负责释放。
+// 满了以后所属线程把数组扩大一倍，旧数组可能还有窃取者在读，
+// 留到队列析构时再释放。
+template <typename T> class ChaseLevDeque {
+  public:
+    explicit ChaseLevDeque(size_t capacity = 256);
+
+    // 以下两个只能由所属线程调用
+    void push(T *item);
+    T *pop();
+
+    // 任意线程调用，队列为空或与其他线程竞争失败时返回nullptr
+    T *steal();
+
+    // 大致的元素个数，并发修改时只作参考
+    size_t size() const;
+
+  private:
+    struct Array {
+        explicit Array(size_t capacity)
+            : capacity(capacity), mask(capacity - 1),
+              slots(new std::atomic<T *>[capacity]) {}
+
+        T *get(int64_t i) const {
+            return slots[i & mask].load(std::memory_order_relaxed);
+        }
+        void put(int64_t i, T *item) {
+            slots[i & mask].store(item, std::memory_order_relaxed);
+        }
+
+        const size_t capacity;
+        const size_t mask;
+        std::unique_ptr<std::atomic<T *>[]> slots;
+    };
+
+    Array *grow(Array *array, int64_t bottom, int64_t top);
+
+    // top和bottom分别被窃取者和所属线程频繁修改，放在不同的cache line上
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    std::atomic<Array *> array;
+    std::vector<std::unique_ptr<Array>> arrays; // 包括已经被替换掉的旧数组
+};
+
+template <typename T>
+ChaseLevDeque<T>::ChaseLevDeque(size_t capacity) : top(0), bottom(0) {
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    arrays.emplace_back(new Array(size));
+    array.store(arrays.back().get(), std::memory_order_relaxed);
+}
+
+template <typename T> void ChaseLevDeque<T>::push(T *item) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Array *a = array.load(std::memory_order_relaxed);
+    if (b - t > static_cast<int64_t>(a->capacity) - 1) {
+        a = grow(a, b, t);
+    }
+    a->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+template <typename T> T *ChaseLevDeque<T>::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Array *a = array.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // 队列为空
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    T *item = a->get(b);
+    if (t == b) {
+        // 只剩最后一个元素，和窃取者抢top
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            item = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+template <typename T> T *ChaseLevDeque<T>::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+        return nullptr;
+    }
+    // 用acquire代替论文中的consume，保证能看到grow拷贝进新数组的元素
+    Array *a = array.load(std::memory_order_acquire);
+    T *item = a->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return item;
+}
+
+template <typename T> size_t ChaseLevDeque<T>::size() const {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_relaxed);
+    return b > t ? static_cast<size_t>(b - t) : 0;
+}
+
+template <typename T>
+typename ChaseLevDeque<T>::Array *
+ChaseLevDeque<T>::grow(Array *old_array, int64_t b, int64_t t) {
+    Array *new_array = new Array(old_array->capacity * 2);
+    for (int64_t i = t; i < b; ++i) {
+        new_array->put(i, old_array->get(i));
+    }
+    arrays.emplace_back(new_array);
+    array.store(new_array, std::memory_order_release);
+    return new_array;
+}
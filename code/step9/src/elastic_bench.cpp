@@ -0,0 +1,142 @@
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+using ThreadPool::Priority;
+
+// 弹性线程池测试：模拟流量的波峰波谷。每毫秒提交一批任务，每个任务
+// 睡kTaskMs毫秒，模拟等待数据库、下游服务这类IO。
+// 负载分三段：平时每毫秒base_rate个任务，持续kQuietMs；
+// 然后burst_factor倍的突发，持续kBurstMs；再回到平时，持续kQuietMs，
+// 最后空闲kIdleMs，看多出来的线程能不能退出。
+// 对比固定min_threads个线程、固定max_threads个线程和弹性线程池的
+// 平均/最大排队时间，以及线程数的变化。
+class ElasticBench {
+  public:
+    ElasticBench(size_t min_threads, size_t max_threads, int base_rate,
+                 int burst_factor);
+    void run();
+
+  private:
+    static const int kTaskMs = 1;
+    static const int kQuietMs = 300;
+    static const int kBurstMs = 200;
+    static const int kIdleMs = 600;
+    // 每隔多少毫秒记录一次线程数
+    static const int kSampleMs = 100;
+
+    void run_pool(ThreadPool::ThreadPool &pool, const char *name);
+    void submit(ThreadPool::ThreadPool &pool, int rate, int duration_ms,
+                std::string &timeline, size_t &peak);
+    void wait_done(ThreadPool::ThreadPool &pool, long total);
+
+    size_t min_threads;
+    size_t max_threads;
+    int base_rate;
+    int burst_factor;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+const int ElasticBench::kTaskMs;
+const int ElasticBench::kQuietMs;
+const int ElasticBench::kBurstMs;
+const int ElasticBench::kIdleMs;
+const int ElasticBench::kSampleMs;
+
+ElasticBench::ElasticBench(size_t min_threads, size_t max_threads,
+                           int base_rate, int burst_factor)
+    : min_threads(min_threads), max_threads(max_threads),
+      base_rate(base_rate), burst_factor(burst_factor) {
+    logger = spdlog::stdout_color_mt("elastic_bench");
+}
+
+// 按每毫秒rate个任务提交duration_ms，顺便采样线程数
+void ElasticBench::submit(ThreadPool::ThreadPool &pool, int rate,
+                          int duration_ms, std::string &timeline,
+                          size_t &peak) {
+    auto start = std::chrono::steady_clock::now();
+    for (int ms = 0; ms < duration_ms; ++ms) {
+        for (int i = 0; i < rate; ++i) {
+            pool.post([]() {
+                std::this_thread::sleep_for(
+                    std::chrono::milliseconds(kTaskMs));
+            });
+        }
+        size_t threads = pool.num_threads();
+        peak = std::max(peak, threads);
+        if (ms % kSampleMs == 0)
+            timeline += " " + std::to_string(threads);
+        std::this_thread::sleep_until(start +
+                                      std::chrono::milliseconds(ms + 1));
+    }
+}
+
+void ElasticBench::wait_done(ThreadPool::ThreadPool &pool, long total) {
+    while (true) {
+        ThreadPool::LaneStats stats = pool.stats(Priority::Normal);
+        if (static_cast<long>(stats.executed + stats.dropped) >= total)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void ElasticBench::run_pool(ThreadPool::ThreadPool &pool, const char *name) {
+    int burst_rate = base_rate * burst_factor;
+    long total = static_cast<long>(base_rate) * kQuietMs * 2 +
+                 static_cast<long>(burst_rate) * kBurstMs;
+    std::string timeline;
+    size_t peak = pool.num_threads();
+
+    auto start = std::chrono::steady_clock::now();
+    submit(pool, base_rate, kQuietMs, timeline, peak);
+    submit(pool, burst_rate, kBurstMs, timeline, peak);
+    submit(pool, base_rate, kQuietMs, timeline, peak);
+    wait_done(pool, total);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    submit(pool, 0, kIdleMs, timeline, peak);
+
+    ThreadPool::LaneStats stats = pool.stats(Priority::Normal);
+    logger->info("{:14}: {:.2f} s, avg delay {:7} us, max delay {:7} us, "
+                 "peak {:2} threads, {:2} after idle",
+                 name, seconds, stats.avg_delay_us, stats.max_delay_us, peak,
+                 pool.num_threads());
+    logger->info("{:14}  threads every {} ms:{}", "", kSampleMs, timeline);
+}
+
+void ElasticBench::run() {
+    logger->info("{}-{} threads, {} tasks/ms, {}x burst for {} ms, "
+                 "{} ms per task",
+                 min_threads, max_threads, base_rate, burst_factor, kBurstMs,
+                 kTaskMs);
+    {
+        ThreadPool::ThreadPool pool(min_threads);
+        run_pool(pool, "fixed min");
+    }
+    {
+        ThreadPool::ThreadPool pool(max_threads);
+        run_pool(pool, "fixed max");
+    }
+    {
+        ThreadPool::ElasticOptions options(min_threads, max_threads);
+        options.idle_timeout = std::chrono::milliseconds(200);
+        ThreadPool::ThreadPool pool(options);
+        run_pool(pool, "elastic");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t min_threads = argc > 1 ? atoi(argv[1]) : 4;
+    size_t max_threads = argc > 2 ? atoi(argv[2]) : 64;
+    int base_rate = argc > 3 ? atoi(argv[3]) : 2;
+    int burst_factor = argc > 4 ? atoi(argv[4]) : 20;
+
+    ElasticBench bench(min_threads, max_threads, base_rate, burst_factor);
+    bench.run();
+    return 0;
+}
@@ -21,6 +21,15 @@ void EpollManager::add(int fd, uint32_t events) {
     }
 }
 
+void EpollManager::modify(int fd, uint32_t events) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        throw std::runtime_error("epoll_ctl failed");
+    }
+}
+
 std::vector<struct epoll_event> EpollManager::wait(int timeout) {
     int num_fds = epoll_wait(epoll_fd, events.data(), max_events, timeout);
     if (num_fds == -1) {
@@ -9,6 +9,8 @@ class EpollManager {
     EpollManager(int max_events);
     ~EpollManager();
     void add(int fd, uint32_t events);
+    // 修改已注册fd的事件，EPOLLONESHOT触发后用它重新打开
+    void modify(int fd, uint32_t events);
     std::vector<struct epoll_event> wait(int timeout);
 
   private:
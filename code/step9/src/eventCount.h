@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// 基于futex的EventCount，让无锁队列的消费者在没有任务时睡眠。
+// 等待方的用法：
+//     EventCount::Key key = ec.prepareWait();
+//     if (再检查一次条件成立) { ec.cancelWait(); 处理; }
+//     else ec.wait(key);
+// 通知方先让条件成立（比如把任务放进队列）再调用notifyOne/notifyAll。
+// prepareWait先登记等待者再读epoch，通知方在条件成立之后才检查等待者，
+// 两边之间有seq_cst，等待方再检查条件时没看到新任务，通知方就一定能看到
+// 等待者并推进epoch，futex在epoch已经变化时不会睡下去，不会丢失唤醒。
+// 没有等待者时notify只有一次fence和一次读，不做系统调用。
+class EventCount {
+  public:
+    using Key = uint32_t;
+
+    EventCount() : epoch(0), waiters(0) {}
+    EventCount(const EventCount &) = delete;
+    EventCount &operator=(const EventCount &) = delete;
+
+    Key prepareWait() {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_seq_cst);
+    }
+
+    void cancelWait() { waiters.fetch_sub(1, std::memory_order_seq_cst); }
+
+    // epoch还等于key时睡眠，直到被notify唤醒；可能虚假唤醒，
+    // 调用方醒来后要重新检查条件
+    void wait(Key key) {
+        while (epoch.load(std::memory_order_acquire) == key) {
+            futex(FUTEX_WAIT_PRIVATE, key);
+        }
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    // 和wait相同，但最多睡timeout；超时返回false。
+    // 超时的等待者可能已经被notify算作唤醒对象，调用方超时后
+    // 要再检查一次条件，不能直接放弃，否则这次唤醒就丢了
+    bool waitFor(Key key, std::chrono::nanoseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        bool woken = true;
+        while (epoch.load(std::memory_order_acquire) == key) {
+            auto left = deadline - std::chrono::steady_clock::now();
+            long long ns =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(left)
+                    .count();
+            if (ns <= 0) {
+                woken = false;
+                break;
+            }
+            struct timespec ts;
+            ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+            ts.tv_nsec = static_cast<long>(ns % 1000000000);
+            futex(FUTEX_WAIT_PRIVATE, key, &ts);
+        }
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+        return woken;
+    }
+
+    void notifyOne() { notify(1); }
+    void notifyAll() { notify(INT_MAX); }
+
+    // 一次放进多个任务时唤醒最多count个等待者
+    void notify(int count) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) == 0)
+            return;
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        futex(FUTEX_WAKE_PRIVATE, static_cast<uint32_t>(count));
+    }
+
+  private:
+    // FUTEX_WAIT的timeout是相对时间
+    void futex(int op, uint32_t value,
+               const struct timespec *timeout = nullptr) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch), op, value,
+                timeout, nullptr, 0);
+    }
+
+    std::atomic<uint32_t> epoch; // 每次唤醒加一，futex等在它上面
+    std::atomic<uint32_t> waiters;
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// 不申请堆内存的任务对象，可调用对象直接构造在内部kCapacity字节的
+// 存储里，整个对象正好一条cache line。只能移动，可以装只能移动的
+// 可调用对象。可调用对象放不下或者对齐要求超过8字节时编译失败，
+// 提交给post()的lambda应该只捕获指针、文件描述符这类小对象。
+class InlineTask {
+  public:
+    static const size_t kCapacity = 56;
+
+    InlineTask() : ops(nullptr) {}
+
+    template <class F, class Callable = typename std::decay<F>::type,
+              class = typename std::enable_if<
+                  !std::is_same<Callable, InlineTask>::value>::type>
+    InlineTask(F &&f) : ops(&Model<Callable>::ops) {
+        static_assert(sizeof(Callable) <= kCapacity,
+                      "callable is too large for InlineTask");
+        static_assert(alignof(Callable) <= alignof(Storage),
+                      "callable is over-aligned for InlineTask");
+        new (&storage) Callable(std::forward<F>(f));
+    }
+
+    InlineTask(InlineTask &&other) : ops(other.ops) {
+        if (ops != nullptr) {
+            ops->move(&storage, &other.storage);
+            other.ops = nullptr;
+        }
+    }
+
+    InlineTask &operator=(InlineTask &&other) {
+        if (this != &other) {
+            reset();
+            ops = other.ops;
+            if (ops != nullptr) {
+                ops->move(&storage, &other.storage);
+                other.ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    InlineTask(const InlineTask &) = delete;
+    InlineTask &operator=(const InlineTask &) = delete;
+
+    ~InlineTask() { reset(); }
+
+    void operator()() { ops->invoke(&storage); }
+    explicit operator bool() const { return ops != nullptr; }
+
+    // 提前析构可调用对象，释放它捕获的资源
+    void reset() {
+        if (ops != nullptr) {
+            ops->destroy(&storage);
+            ops = nullptr;
+        }
+    }
+
+  private:
+    using Storage = std::aligned_storage<kCapacity, 8>::type;
+
+    // 按可调用对象类型生成的操作表，InlineTask里只存一个指针
+    struct Ops {
+        void (*invoke)(void *);
+        void (*move)(void *dst, void *src); // 移动构造到dst并析构src
+        void (*destroy)(void *);
+    };
+
+    template <class F> struct Model {
+        static void invoke(void *p) { (*static_cast<F *>(p))(); }
+        static void move(void *dst, void *src) {
+            F *f = static_cast<F *>(src);
+            new (dst) F(std::move(*f));
+            f->~F();
+        }
+        static void destroy(void *p) { static_cast<F *>(p)->~F(); }
+
+        static const Ops ops;
+    };
+
+    Storage storage;
+    const Ops *ops;
+};
+
+template <class F>
+const InlineTask::Ops InlineTask::Model<F>::ops = {
+    &InlineTask::Model<F>::invoke, &InlineTask::Model<F>::move,
+    &InlineTask::Model<F>::destroy};
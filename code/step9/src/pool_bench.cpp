@@ -0,0 +1,106 @@
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include "threadPool.h"
+#include "workStealingPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+// 线程池任务分发的竞争测试，工作线程数从1到max_threads按2倍递增。
+// external：主线程连续提交num_tasks个空任务，和事件循环分发请求一样；
+// spawn：每个任务在工作线程里再提交两个子任务，共2^(depth+1)-1个。
+//        ThreadPool的所有任务都经过同一个全局队列，
+//        WorkStealingPool的子任务压在本线程的队列里，空闲线程再来偷。
+// 统计从开始提交到全部任务执行完的吞吐，不含创建和销毁线程池的时间。
+class PoolBench {
+  public:
+    PoolBench(int max_threads, long num_tasks, int depth);
+    void run();
+
+  private:
+    template <class Pool> double run_external(size_t num_threads);
+    template <class Pool> double run_spawn(size_t num_threads);
+    template <class Pool> void spawn(Pool &pool, int depth);
+    void wait_done(long expected);
+
+    int max_threads;
+    long num_tasks;
+    int depth;
+    std::atomic<long> done;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+PoolBench::PoolBench(int max_threads, long num_tasks, int depth)
+    : max_threads(max_threads), num_tasks(num_tasks), depth(depth), done(0) {
+    logger = spdlog::stdout_color_mt("pool_bench");
+}
+
+void PoolBench::wait_done(long expected) {
+    while (done.load(std::memory_order_acquire) < expected) {
+        std::this_thread::yield();
+    }
+}
+
+template <class Pool> double PoolBench::run_external(size_t num_threads) {
+    Pool pool(num_threads);
+    done.store(0);
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < num_tasks; ++i) {
+        pool.enqueue(
+            [this]() { done.fetch_add(1, std::memory_order_release); });
+    }
+    wait_done(num_tasks);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return num_tasks / seconds / 1e6;
+}
+
+template <class Pool> void PoolBench::spawn(Pool &pool, int depth) {
+    if (depth > 0) {
+        for (int i = 0; i < 2; ++i) {
+            pool.enqueue([this, &pool, depth]() { spawn(pool, depth - 1); });
+        }
+    }
+    done.fetch_add(1, std::memory_order_release);
+}
+
+template <class Pool> double PoolBench::run_spawn(size_t num_threads) {
+    Pool pool(num_threads);
+    done.store(0);
+    const long total = (2L << depth) - 1;
+    auto start = std::chrono::steady_clock::now();
+    pool.enqueue([this, &pool]() { spawn(pool, depth); });
+    wait_done(total);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return total / seconds / 1e6;
+}
+
+void PoolBench::run() {
+    logger->info("M tasks/s, external: {} tasks, spawn: {} tasks", num_tasks,
+                 (2L << depth) - 1);
+    for (int n = 1; n <= max_threads; n *= 2) {
+        double shared_external = run_external<ThreadPool::ThreadPool>(n);
+        double stealing_external =
+            run_external<ThreadPool::WorkStealingPool>(n);
+        double shared_spawn = run_spawn<ThreadPool::ThreadPool>(n);
+        double stealing_spawn = run_spawn<ThreadPool::WorkStealingPool>(n);
+        logger->info("{:2} threads | external: shared {:.2f}, stealing {:.2f} "
+                     "| spawn: shared {:.2f}, stealing {:.2f}",
+                     n, shared_external, stealing_external, shared_spawn,
+                     stealing_spawn);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 64;
+    long num_tasks = argc > 2 ? atol(argv[2]) : 200000;
+    int depth = argc > 3 ? atoi(argv[3]) : 16;
+
+    PoolBench bench(max_threads, num_tasks, depth);
+    bench.run();
+    return 0;
+}
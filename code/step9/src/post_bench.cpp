@@ -0,0 +1,121 @@
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include "threadPool.h"
+#include "workStealingPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+// 统计全进程的堆分配次数
+static std::atomic<long> allocations(0);
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+// 任务提交开销测试：主线程连续提交num_tasks个任务，和Server::run一样
+// 每个任务只捕获一个指针和一个fd，丢弃future。
+// enqueue：packaged_task + future；post：可调用对象直接放进队列槽位；
+// post_bulk：每kBatch个任务一批，和一次epoll_wait返回一批事件一样；
+// worker：由一个任务在工作线程里post全部任务，走工作线程提交的路径。
+// 统计从开始提交到全部执行完的平均耗时和每个任务的堆分配次数，
+// 不含创建和销毁线程池。
+class PostBench {
+  public:
+    PostBench(int num_threads, long num_tasks);
+    void run();
+
+  private:
+    static const int kBatch = 10;
+
+    template <class Pool> void run_mode(const char *pool_name);
+    template <class Pool> void post_all(Pool &pool);
+    void wait_done();
+    void task(int fd);
+
+    int num_threads;
+    long num_tasks;
+    std::atomic<long> done;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+PostBench::PostBench(int num_threads, long num_tasks)
+    : num_threads(num_threads), num_tasks(num_tasks), done(0) {
+    logger = spdlog::stdout_color_mt("post_bench");
+}
+
+void PostBench::task(int fd) {
+    done.fetch_add(fd > 0 ? 1 : 0, std::memory_order_release);
+}
+
+void PostBench::wait_done() {
+    while (done.load(std::memory_order_acquire) < num_tasks) {
+        std::this_thread::yield();
+    }
+}
+
+template <class Pool> void PostBench::run_mode(const char *pool_name) {
+    static const char *modes[] = {"enqueue", "post", "post_bulk", "worker"};
+    Pool pool(num_threads);
+    InlineTask batch[kBatch];
+    for (int mode = 0; mode < 4; ++mode) {
+        done.store(0);
+        long before = allocations.load();
+        auto start = std::chrono::steady_clock::now();
+        int batch_size = 0;
+        if (mode == 3)
+            pool.post([this, &pool]() { post_all(pool); });
+        for (long i = 0; i < num_tasks && mode < 3; ++i) {
+            int fd = static_cast<int>(i % 1000) + 1;
+            if (mode == 0) {
+                pool.enqueue([this, fd]() { task(fd); });
+            } else if (mode == 1) {
+                pool.post([this, fd]() { task(fd); });
+            } else {
+                batch[batch_size++] = InlineTask([this, fd]() { task(fd); });
+                if (batch_size == kBatch || i == num_tasks - 1) {
+                    pool.post_bulk(batch, batch + batch_size);
+                    batch_size = 0;
+                }
+            }
+        }
+        wait_done();
+        double ns = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        long count = allocations.load() - before;
+        logger->info("{:16} {:9}: {:6.1f} ns/task, {:.2f} allocs/task",
+                     pool_name, modes[mode],
+                     ns / num_tasks, static_cast<double>(count) / num_tasks);
+    }
+}
+
+template <class Pool> void PostBench::post_all(Pool &pool) {
+    for (long i = 0; i < num_tasks; ++i) {
+        int fd = static_cast<int>(i % 1000) + 1;
+        pool.post([this, fd]() { task(fd); });
+    }
+}
+
+void PostBench::run() {
+    logger->info("{} threads, {} tasks", num_threads, num_tasks);
+    run_mode<ThreadPool::ThreadPool>("ThreadPool");
+    run_mode<ThreadPool::WorkStealingPool>("WorkStealingPool");
+}
+
+int main(int argc, char *argv[]) {
+    int num_threads = argc > 1 ? atoi(argv[1]) : 4;
+    long num_tasks = argc > 2 ? atol(argv[2]) : 1000000;
+
+    PostBench bench(num_threads, num_tasks);
+    bench.run();
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include "threadPool.h"
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+using ThreadPool::Priority;
+
+// 优先级测试：先一次提交num_background个后台任务（每个忙等work_us），
+// 然后每毫秒提交一个交互任务，共num_probes个，带deadline_ms的截止时间。
+// fifo模式所有任务都放Normal，和原来的单队列一样；
+// lanes模式后台任务放Background，交互任务放Interactive。
+// 比较交互任务的排队时间和因为超时被丢弃的数量。
+class PriorityBench {
+  public:
+    PriorityBench(int num_threads, int num_background, int num_probes,
+                  int work_us, int deadline_ms);
+    void run();
+
+  private:
+    void run_mode(bool use_lanes);
+    void work();
+    void report(ThreadPool::ThreadPool &pool, Priority priority,
+                const char *name);
+
+    int num_threads;
+    int num_background;
+    int num_probes;
+    int work_us;
+    int deadline_ms;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+PriorityBench::PriorityBench(int num_threads, int num_background,
+                             int num_probes, int work_us, int deadline_ms)
+    : num_threads(num_threads), num_background(num_background),
+      num_probes(num_probes), work_us(work_us), deadline_ms(deadline_ms) {
+    logger = spdlog::stdout_color_mt("priority_bench");
+}
+
+void PriorityBench::work() {
+    auto end = std::chrono::steady_clock::now() +
+               std::chrono::microseconds(work_us);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+void PriorityBench::report(ThreadPool::ThreadPool &pool, Priority priority,
+                           const char *name) {
+    ThreadPool::LaneStats stats = pool.stats(priority);
+    logger->info("  {:11}: executed {:6}, dropped {:4}, "
+                 "avg delay {:7} us, max delay {:7} us",
+                 name, stats.executed, stats.dropped, stats.avg_delay_us,
+                 stats.max_delay_us);
+}
+
+void PriorityBench::run_mode(bool use_lanes) {
+    Priority background = use_lanes ? Priority::Background : Priority::Normal;
+    Priority interactive =
+        use_lanes ? Priority::Interactive : Priority::Normal;
+    ThreadPool::ThreadPool pool(num_threads);
+
+    for (int i = 0; i < num_background; ++i)
+        pool.post(background, [this]() { work(); });
+    for (int i = 0; i < num_probes; ++i) {
+        auto deadline = ThreadPool::ThreadPool::Clock::now() +
+                        std::chrono::milliseconds(deadline_ms);
+        pool.post(interactive, deadline, [this]() { work(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // 等所有任务执行完或被丢弃
+    long total = num_background + num_probes;
+    while (true) {
+        long finished = 0;
+        for (int lane = 0; lane < 3; ++lane) {
+            ThreadPool::LaneStats stats =
+                pool.stats(static_cast<Priority>(lane));
+            finished += stats.executed + stats.dropped;
+        }
+        if (finished >= total)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    logger->info("{}:", use_lanes ? "lanes" : "fifo");
+    report(pool, Priority::Interactive, "interactive");
+    report(pool, Priority::Normal, "normal");
+    report(pool, Priority::Background, "background");
+}
+
+void PriorityBench::run() {
+    logger->info("{} threads, {} background tasks, {} probes, "
+                 "{} us per task, {} ms deadline",
+                 num_threads, num_background, num_probes, work_us,
+                 deadline_ms);
+    run_mode(false);
+    run_mode(true);
+}
+
+int main(int argc, char *argv[]) {
+    int num_threads = argc > 1 ? atoi(argv[1]) : 4;
+    int num_background = argc > 2 ? atoi(argv[2]) : 5000;
+    int num_probes = argc > 3 ? atoi(argv[3]) : 100;
+    int work_us = argc > 4 ? atoi(argv[4]) : 50;
+    int deadline_ms = argc > 5 ? atoi(argv[5]) : 20;
+
+    PriorityBench bench(num_threads, num_background, num_probes, work_us,
+                        deadline_ms);
+    bench.run();
+    return 0;
+}
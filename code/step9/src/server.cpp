@@ -1,11 +1,19 @@
 #include "server.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
 #define MAX_EVENTS 10
+
+const int Server::kStatsIntervalMs;
+
 Server::Server(int port, int buffer_size, int max_pending_connections,
-               int max_thread_pools)
+               int min_threads, int max_threads)
     : port(port), buffer_size(buffer_size),
       max_pending_connections(max_pending_connections),
-      addrlen(sizeof(address)), thread_pool(max_thread_pools),
-      epoll_manager(MAX_EVENTS) {
+      addrlen(sizeof(address)),
+      thread_pool(ThreadPool::ElasticOptions(min_threads, max_threads)),
+      epoll_manager(MAX_EVENTS), reported_executed(0) {
     logger = spdlog::stdout_color_mt("server");
     logger->set_level(spdlog::level::info);
     init();
@@ -40,68 +48,170 @@ void Server::init() {
 }
 
 void Server::run() {
+    // 一次epoll_wait里可读的客户端放进各自的Strand，原来空闲的Strand的
+    // runner攒成一批，用一次post_bulk放进Interactive lane。
+    // Strand一轮执行满kMaxRun个任务后用post重新排队，落在Normal lane，
+    // 排在新来的客户端事件后面。统计报告放Background lane
+    InlineTask batch[MAX_EVENTS];
+    std::chrono::milliseconds stats_interval(kStatsIntervalMs);
+    Clock::time_point next_report = Clock::now() + stats_interval;
     while (true) {
-        auto events = epoll_manager.wait(-1);
+        auto events = epoll_manager.wait(kStatsIntervalMs);
+        size_t batch_size = 0;
         for (auto &event : events) {
             if (event.data.fd == server_fd) {
-                int new_socket;
-                if ((new_socket = accept(server_fd, (struct sockaddr *)&address,
-                                         &addrlen)) < 0) {
-                    logger->error("accept failed");
+                accept_client();
+                continue;
+            }
+            int client_socket = event.data.fd;
+            std::shared_ptr<ClientStrand> strand;
+            {
+                std::lock_guard<std::mutex> lock(strands_mutex);
+                auto it = strands.find(client_socket);
+                if (it == strands.end())
                     continue;
-                }
-                logger->info("Connection from {}:{}",
-                             inet_ntoa(address.sin_addr),
-                             ntohs(address.sin_port));
-                epoll_manager.add(new_socket, EPOLLIN | EPOLLET);
-            } else {
-                int client_socket = event.data.fd;
-                thread_pool.enqueue(
-                    [this, client_socket]() { handle_client(client_socket); });
+                strand = it->second;
             }
+            if (strand->push(
+                    [this, client_socket]() { handle_client(client_socket); }))
+                batch[batch_size++] = strand->runner();
+        }
+        thread_pool.post_bulk(batch, batch + batch_size,
+                              ThreadPool::Priority::Interactive);
+
+        Clock::time_point now = Clock::now();
+        if (now >= next_report) {
+            // 到下一次报告时还没执行，这份统计就没用了，直接丢弃
+            next_report = now + stats_interval;
+            thread_pool.post(ThreadPool::Priority::Background, next_report,
+                             [this]() { report_stats(); });
         }
     }
 }
 
+void Server::accept_client() {
+    int new_socket;
+    if ((new_socket = accept(server_fd, (struct sockaddr *)&address,
+                             &addrlen)) < 0) {
+        logger->error("accept failed");
+        return;
+    }
+    logger->info("Connection from {}:{}", inet_ntoa(address.sin_addr),
+                 ntohs(address.sin_port));
+    // 非阻塞读，handle_client读到EAGAIN就返回，不会占着工作线程等数据
+    int flags = fcntl(new_socket, F_GETFL, 0);
+    fcntl(new_socket, F_SETFL, flags | O_NONBLOCK);
+    {
+        std::lock_guard<std::mutex> lock(strands_mutex);
+        strands[new_socket] = std::make_shared<ClientStrand>(thread_pool);
+    }
+    epoll_manager.add(new_socket, kClientEvents);
+}
+
+// 在连接的Strand里执行，读完当前所有数据后重新打开EPOLLONESHOT
 void Server::handle_client(int client_socket) {
-    char buffer[buffer_size] = {0};
+    char buffer[buffer_size];
     while (true) {
-        int valread = read(client_socket, buffer, buffer_size);
+        ssize_t valread = read(client_socket, buffer, buffer_size - 1);
+        if (valread < 0 && errno == EINTR)
+            continue;
+        if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // 在工作线程里，异常不能抛出去，重新打开失败就关闭连接
+            try {
+                epoll_manager.modify(client_socket, kClientEvents);
+            } catch (const std::runtime_error &e) {
+                logger->error("{}, closing connection", e.what());
+                close_client(client_socket);
+            }
+            return;
+        }
         if (valread <= 0) {
             if (valread == 0) {
                 logger->info("Client disconnected");
             } else {
                 logger->error("read error");
             }
-            close(client_socket);
-            break;
+            close_client(client_socket);
+            return;
         }
 
         buffer[valread] = '\0';
 
         std::string response = "server: ";
         response.append(buffer);
-        send(client_socket, response.c_str(), response.length(), 0);
+        if (!send_all(client_socket, response)) {
+            logger->error("send failed, closing connection");
+            close_client(client_socket);
+            return;
+        }
         logger->info("Sent data: {}", response);
 
         if (strcmp(buffer, "exit") == 0) {
             logger->info("Received exit message, closing connection");
-            close(client_socket);
-            break;
+            close_client(client_socket);
+            return;
+        }
+    }
+}
+
+// 非阻塞socket上send可能只写出一部分，也可能返回EAGAIN，
+// 循环写到全部发完；发送缓冲区满时用poll等到可写再继续
+bool Server::send_all(int client_socket, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(client_socket, data.data() + sent, data.size() - sent,
+                         MSG_NOSIGNAL);
+        if (n >= 0) {
+            sent += static_cast<size_t>(n);
+            continue;
         }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return false;
+        struct pollfd pfd;
+        pfd.fd = client_socket;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, kSendTimeoutMs);
+        if (ready == 0 || (ready < 0 && errno != EINTR))
+            return false;
+    }
+    return true;
+}
 
-        memset(buffer, 0, buffer_size);
+// 先删掉Strand再close，fd号被新连接复用时不会拿到旧的Strand。
+// 正在执行的runner自己持有Strand，这里删掉不影响它执行完
+void Server::close_client(int client_socket) {
+    {
+        std::lock_guard<std::mutex> lock(strands_mutex);
+        strands.erase(client_socket);
     }
     close(client_socket);
 }
 
+// 在Background lane执行。两次报告之间没有处理过客户端请求就不打印，
+// 空闲时不刷日志
+void Server::report_stats() {
+    ThreadPool::LaneStats stats =
+        thread_pool.stats(ThreadPool::Priority::Interactive);
+    if (reported_executed.exchange(stats.executed) == stats.executed)
+        return;
+    logger->info("Pool: {} threads, {} client tasks, avg delay {} us, "
+                 "max delay {} us",
+                 thread_pool.num_threads(), stats.executed,
+                 stats.avg_delay_us, stats.max_delay_us);
+}
+
 int main() {
     const int PORT = 8080;
     const int BUFFER_SIZE = 1024;
     const int MAX_PENDING_CONNECTIONS = 3;
-    const int THREAD_POOL_SIZE = 5;
+    const int THREAD_POOL_SIZE = 5;      // 线程池平时的大小
+    const int MAX_THREAD_POOL_SIZE = 32; // 负载高时最多的线程数
 
-    Server server(PORT, BUFFER_SIZE, MAX_PENDING_CONNECTIONS, THREAD_POOL_SIZE);
+    Server server(PORT, BUFFER_SIZE, MAX_PENDING_CONNECTIONS, THREAD_POOL_SIZE,
+                  MAX_THREAD_POOL_SIZE);
     server.run();
 
     return 0;
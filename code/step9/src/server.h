@@ -4,23 +4,45 @@
 #include "epollManager.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
+#include "strand.h"
 #include "threadPool.h"
 #include <arpa/inet.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <netinet/in.h>
+#include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <unordered_map>
 
 class Server {
   public:
+    // 线程池是弹性的，线程数在min_threads和max_threads之间随负载变化
     Server(int port, int buffer_size, int max_pending_connections,
-           int max_thread_pools);
+           int min_threads, int max_threads);
     ~Server();
     void run();
 
   private:
+    using ClientStrand = ThreadPool::Strand<ThreadPool::ThreadPool>;
+    using Clock = ThreadPool::ThreadPool::Clock;
+
+    // 客户端fd注册的事件。EPOLLONESHOT保证一次事件只交给一个工作线程，
+    // handle_client读完以后再重新打开
+    static const uint32_t kClientEvents = EPOLLIN | EPOLLET | EPOLLONESHOT;
+    // 发送缓冲区满时等待可写的最长时间，超过就当作发送失败
+    static const int kSendTimeoutMs = 5000;
+    // 多久打印一次线程池的统计
+    static const int kStatsIntervalMs = 10000;
+
     void init();
+    void accept_client();
     void handle_client(int client_socket);
+    bool send_all(int client_socket, const std::string &data);
+    void close_client(int client_socket);
+    void report_stats();
 
     int server_fd;
     int port;
@@ -31,6 +53,14 @@ class Server {
     std::shared_ptr<spdlog::logger> logger;
     ThreadPool::ThreadPool thread_pool;
     EpollManager epoll_manager;
+
+    // 每个连接一个Strand，同一个连接的处理串行执行。
+    // 事件循环和关闭连接的工作线程都会访问，用锁保护
+    std::mutex strands_mutex;
+    std::unordered_map<int, std::shared_ptr<ClientStrand>> strands;
+
+    // 上次打印统计时Interactive lane执行过的任务数
+    std::atomic<uint64_t> reported_executed;
 };
 
 #endif // SERVER_H
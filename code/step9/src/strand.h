@@ -0,0 +1,80 @@
+#pragma once
+
+#include "inlineTask.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace ThreadPool {
+
+// 串行执行器：同一个Strand里的任务按提交顺序执行，任意时刻最多一个
+// 在运行；不同Strand的任务在线程池里并行。用法和asio的strand相同，
+// 比如每个连接一个Strand，同一个fd不会被两个工作线程同时处理。
+// Strand本身不占线程：有任务而且没在运行时，把一个runner交给线程池，
+// runner依次执行队列里的任务，队列空了就退出。
+// runner持有Strand的shared_ptr，所以Strand必须用std::make_shared创建，
+// 最后一个任务执行完之前不会被析构。
+template <class Pool>
+class Strand : public std::enable_shared_from_this<Strand<Pool>> {
+  public:
+    explicit Strand(Pool &pool) : pool(pool), running(false) {}
+
+    // 提交任务，Strand空闲时顺便把runner交给线程池
+    template <class F> void post(F &&f);
+
+    // 只放进队列：返回true表示Strand原来空闲，调用方必须把runner()
+    // 交给线程池。事件循环用它把一批runner攒起来一次post_bulk
+    template <class F> bool push(F &&f);
+    InlineTask runner();
+
+  private:
+    // runner每轮最多执行的任务数，之后重新排队，
+    // 一个忙的连接不会一直占着工作线程
+    static const size_t kMaxRun = 16;
+
+    void run();
+
+    Pool &pool;
+    std::mutex mutex;
+    std::deque<InlineTask> tasks;
+    bool running; // 有runner在线程池里排队或正在执行
+};
+
+template <class Pool> template <class F> void Strand<Pool>::post(F &&f) {
+    if (push(std::forward<F>(f)))
+        pool.post(runner());
+}
+
+template <class Pool> template <class F> bool Strand<Pool>::push(F &&f) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.emplace_back(std::forward<F>(f));
+    if (running)
+        return false;
+    running = true;
+    return true;
+}
+
+template <class Pool> InlineTask Strand<Pool>::runner() {
+    std::shared_ptr<Strand> self = this->shared_from_this();
+    return InlineTask([self]() { self->run(); });
+}
+
+template <class Pool> void Strand<Pool>::run() {
+    for (size_t i = 0; i < kMaxRun; ++i) {
+        InlineTask task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty()) {
+                running = false;
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+    // 还没执行完，running保持为true，重新排到线程池队尾
+    pool.post(runner());
+}
+
+} // namespace ThreadPool
@@ -1,44 +1,230 @@
 
 #pragma once
 
-#include <boost/lockfree/queue.hpp>
+#include "eventCount.h"
+#include "inlineTask.h"
+#include "mpmcQueue.h"
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
 #include <functional>
 #include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace ThreadPool {
 
+// 任务优先级，每个优先级一条队列（lane）。
+// 管理命令、健康检查这类要求低延迟的任务用Interactive，
+// 不会排在大批普通任务后面；批量的后台工作用Background
+enum class Priority { Interactive, Normal, Background };
+
+// 一条lane的统计，排队时间是从提交到开始执行
+struct LaneStats {
+    uint64_t executed;     // 执行了的任务数
+    uint64_t dropped;      // 过了截止时间被丢弃的任务数
+    uint64_t avg_delay_us; // 执行了的任务的平均排队时间
+    uint64_t max_delay_us; // 最大排队时间
+};
+
+// 弹性线程池的参数。任务的排队时间超过grow_delay时加一个线程，
+// 工作线程都卡在长任务里时由提交任务的线程来加；
+// 两次加线程至少间隔grow_interval；线程空闲idle_timeout以后退出，
+// 最近idle_timeout之内加过线程时也不退出。加线程看毫秒级的排队时间，
+// 减线程要空闲秒级的时间，中间的差距防止线程数来回振荡
+struct ElasticOptions {
+    ElasticOptions(size_t min_threads, size_t max_threads)
+        : min_threads(min_threads), max_threads(max_threads),
+          grow_delay(std::chrono::milliseconds(2)),
+          grow_interval(std::chrono::milliseconds(2)),
+          idle_timeout(std::chrono::seconds(1)) {}
+
+    size_t min_threads;
+    size_t max_threads;
+    std::chrono::nanoseconds grow_delay;
+    std::chrono::nanoseconds grow_interval;
+    std::chrono::nanoseconds idle_timeout;
+};
+
 class ThreadPool {
   public:
+    using Clock = std::chrono::steady_clock;
+
+    // 固定大小的线程池
     ThreadPool(size_t num_threads);
+    // 弹性线程池，线程数在min_threads和max_threads之间随负载变化
+    explicit ThreadPool(const ElasticOptions &options);
     ~ThreadPool();
 
-    // 添加任务到线程池
+    // 添加任务到线程池，不指定优先级的都是Normal
     template <class F, class... Args>
     auto enqueue(F &&f, Args &&...args) -> std::future<decltype(f(args...))>;
+    template <class F, class... Args>
+    auto enqueue(Priority priority, F &&f, Args &&...args)
+        -> std::future<decltype(f(args...))>;
+
+    // 提交不需要返回值的任务，可调用对象直接放进队列的槽位，
+    // 不创建packaged_task和future，也不申请堆内存。
+    // 队列满时外部线程等工作线程腾出位置；工作线程自己提交时不能等，
+    // 放进预先分配的spill队列，spill也满了就在当前线程直接执行
+    template <class F> void post(F &&f);
+    template <class F> void post(Priority priority, F &&f);
+    // 到deadline还没开始执行的任务直接丢弃，不再执行，计入dropped
+    template <class F>
+    void post(Priority priority, Clock::time_point deadline, F &&f);
+
+    // 批量版本，整批用一次CAS放进队列，只唤醒一次。
+    // enqueue_bulk的元素是无参数的可调用对象；
+    // post_bulk的元素是InlineTask，会被移走，It要求是随机访问迭代器
+    template <class It>
+    auto enqueue_bulk(It first, It last)
+        -> std::vector<std::future<decltype((*first)())>>;
+    template <class It>
+    void post_bulk(It first, It last, Priority priority = Priority::Normal);
+
+    // 读取一条lane的统计，各项分别读取，不是同一时刻的快照
+    LaneStats stats(Priority priority) const;
+
+    // 当前的工作线程数
+    size_t num_threads() const { return num_workers.load(); }
 
   private:
+    // 队列空了以后先自旋的轮数，之后在idle上睡眠
+    static const int kSpinRounds = 64;
+    // 每条lane的任务队列的槽位数
+    static const size_t kQueueCapacity = 1024;
+    // 每条lane的spill队列的槽位数
+    static const size_t kSpillCapacity = 256;
+    // 工作线程一次最多取出的任务数
+    static const size_t kMaxBatch = 8;
+    static const size_t kNumLanes = 3;
+
+    // 队列里的任务，带着提交时间和截止时间
+    struct Job {
+        Job() {}
+        // post_bulk直接从InlineTask构造，没有截止时间
+        explicit Job(InlineTask &&task)
+            : task(std::move(task)), enqueued(Clock::now()),
+              deadline(Clock::time_point::max()) {}
+        Job(InlineTask &&task, Clock::time_point deadline)
+            : task(std::move(task)), enqueued(Clock::now()),
+              deadline(deadline) {}
+
+        InlineTask task;
+        Clock::time_point enqueued;
+        Clock::time_point deadline;
+    };
+
+    struct Lane {
+        Lane()
+            : jobs(kQueueCapacity), spill(kSpillCapacity), executed(0),
+              dropped(0), total_delay_ns(0), max_delay_ns(0) {}
+
+        // 任务按值存放在环形队列的槽位里
+        MPMCQueue<Job> jobs;
+
+        // 环形队列满了以后工作线程自己提交的任务放在这里。工作线程不能
+        // 原地等空位，否则所有工作线程都在等彼此
+        MPMCQueue<Job> spill;
+
+        // 统计，工作线程执行每个任务时更新，单独占cache line
+        alignas(64) std::atomic<uint64_t> executed;
+        std::atomic<uint64_t> dropped;
+        std::atomic<uint64_t> total_delay_ns;
+        std::atomic<uint64_t> max_delay_ns;
+    };
+
+    static size_t scheduled_lane(size_t turn);
+    // 当前线程所属的线程池，非工作线程为nullptr
+    static ThreadPool *&current_pool();
+
+    void push(Lane &lane, Job &&job);
+    bool pop(Lane &lane, Job &job);
+    size_t take(Lane &lane, Job *batch);
+    void run_job(Lane &lane, Job &job);
+    bool has_work() const;
+
+    void start_workers();
+    void check_grow();
+    void maybe_grow(Clock::time_point now);
+    bool try_retire();
+    Clock::time_point retire_time(Clock::time_point idle_since) const;
+
     // 线程需要执行的工作函数
     void worker_thread();
 
-    // 线程池中的工作线程
+    // 线程池中的工作线程，弹性模式下会增减，用workers_mutex保护。
+    // 退出的线程把id放进exited，下次加线程或者析构时join
+    std::mutex workers_mutex;
     std::vector<std::thread> workers;
+    std::vector<std::thread::id> exited;
+    // 工作线程启动时workers还在构造，数量单独保存；
+    // 要退出的线程先把它减一，所以不会少于min_workers
+    std::atomic<size_t> num_workers;
+
+    size_t min_workers;
+    size_t max_workers;
+    Clock::duration grow_delay;
+    Clock::duration grow_interval;
+    Clock::duration idle_timeout;
+    // 上次加线程的时间，从Clock的纪元开始的计数
+    std::atomic<Clock::rep> last_grow;
+    // 弹性模式下最近一次有任务开始执行、或者队列从空变成非空的时间
+    std::atomic<Clock::rep> last_progress;
 
-    // 任务队列
-    boost::lockfree::queue<std::function<void()> *> tasks;
+    // 按Priority的顺序，每个优先级一条lane
+    Lane lanes[kNumLanes];
 
     std::atomic<bool> stop;
+
+    // 空闲工作线程在这里睡眠，enqueue有睡眠的线程时才唤醒一个
+    EventCount idle;
+    // 环形队列满时外部提交的线程在这里等，工作线程取出任务后唤醒
+    EventCount space;
 };
 
-// 构造函数，启动指定数量的工作线程
-inline ThreadPool::ThreadPool(size_t num_threads) : tasks(128), stop(false) {
-    for (size_t i = 0; i < num_threads; ++i)
+// 构造函数，启动指定数量的工作线程，min和max相同时线程数不变
+inline ThreadPool::ThreadPool(size_t num_threads)
+    : num_workers(num_threads), min_workers(num_threads),
+      max_workers(num_threads), grow_delay(Clock::duration::max()),
+      grow_interval(Clock::duration::max()),
+      idle_timeout(Clock::duration::max()),
+      last_grow(Clock::now().time_since_epoch().count()),
+      last_progress(last_grow.load()), stop(false) {
+    start_workers();
+}
+
+// 至少保留一个线程，队列里的任务总有人执行
+inline ThreadPool::ThreadPool(const ElasticOptions &options)
+    : num_workers(options.min_threads > 0 ? options.min_threads : 1),
+      min_workers(num_workers.load()),
+      max_workers(std::max(options.max_threads, num_workers.load())),
+      grow_delay(options.grow_delay), grow_interval(options.grow_interval),
+      idle_timeout(options.idle_timeout),
+      last_grow(Clock::now().time_since_epoch().count()),
+      last_progress(last_grow.load()), stop(false) {
+    start_workers();
+}
+
+inline void ThreadPool::start_workers() {
+    std::lock_guard<std::mutex> lock(workers_mutex);
+    for (size_t i = 0; i < min_workers; ++i)
         workers.emplace_back([this] { worker_thread(); });
 }
 
-// 析构函数，等待所有线程完成后销毁线程池
+// 析构函数，等待所有线程完成后销毁线程池。
+// 设置stop以后不会再加线程，取出来的就是全部线程
 inline ThreadPool::~ThreadPool() {
     stop.store(true);
-    for (std::thread &worker : workers)
+    idle.notifyAll();
+    space.notifyAll();
+    std::vector<std::thread> all;
+    {
+        std::lock_guard<std::mutex> lock(workers_mutex);
+        all.swap(workers);
+    }
+    for (std::thread &worker : all)
         worker.join();
 }
 
@@ -46,6 +232,13 @@ inline ThreadPool::~ThreadPool() {
 template <class F, class... Args>
 auto ThreadPool::enqueue(F &&f,
                          Args &&...args) -> std::future<decltype(f(args...))> {
+    return enqueue(Priority::Normal, std::forward<F>(f),
+                   std::forward<Args>(args)...);
+}
+
+template <class F, class... Args>
+auto ThreadPool::enqueue(Priority priority, F &&f, Args &&...args)
+    -> std::future<decltype(f(args...))> {
     using return_type = decltype(f(args...));
     // 创建一个任务指向的智能指针，使它可以异步地获取值或异常
     auto task = std::make_shared<std::packaged_task<return_type()>>(
@@ -53,25 +246,277 @@ auto ThreadPool::enqueue(F &&f,
 
     std::future<return_type> res = task->get_future();
 
-    // 向队列中添加任务// 向队列中添加任务
-    auto wrapped_task = new std::function<void()>([task]() { (*task)(); });
-    while (!tasks.push(wrapped_task)) {
-    }
+    // 向队列中添加任务
+    post(priority, [task]() { (*task)(); });
+    return res;
+}
+
+template <class F> void ThreadPool::post(F &&f) {
+    post(Priority::Normal, std::forward<F>(f));
+}
 
+template <class F> void ThreadPool::post(Priority priority, F &&f) {
+    post(priority, Clock::time_point::max(), std::forward<F>(f));
+}
+
+template <class F>
+void ThreadPool::post(Priority priority, Clock::time_point deadline, F &&f) {
+    check_grow();
+    push(lanes[static_cast<size_t>(priority)],
+         Job(InlineTask(std::forward<F>(f)), deadline));
+    idle.notifyOne();
+}
+
+template <class It>
+auto ThreadPool::enqueue_bulk(It first, It last)
+    -> std::vector<std::future<decltype((*first)())>> {
+    using return_type = decltype((*first)());
+    std::vector<std::future<return_type>> res;
+    std::vector<InlineTask> batch;
+    for (; first != last; ++first) {
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+            std::move(*first));
+        res.push_back(task->get_future());
+        batch.emplace_back([task]() { (*task)(); });
+    }
+    post_bulk(batch.begin(), batch.end());
     return res;
 }
 
-// 工作线程函数，从队列中取出任务并执行
+// 环形队列放不下的部分逐个交给push，先唤醒工作线程来取已经放进去的
+template <class It>
+void ThreadPool::post_bulk(It first, It last, Priority priority) {
+    size_t count = static_cast<size_t>(last - first);
+    if (count == 0)
+        return;
+    check_grow();
+    Lane &lane = lanes[static_cast<size_t>(priority)];
+    size_t n = lane.jobs.try_enqueue_bulk(first, count);
+    if (n > 0)
+        idle.notify(static_cast<int>(n));
+    for (It it = first + n; it != last; ++it) {
+        push(lane, Job(std::move(*it)));
+        idle.notifyOne();
+    }
+}
+
+inline LaneStats ThreadPool::stats(Priority priority) const {
+    const Lane &lane = lanes[static_cast<size_t>(priority)];
+    LaneStats result;
+    result.executed = lane.executed.load();
+    result.dropped = lane.dropped.load();
+    result.avg_delay_us =
+        result.executed > 0
+            ? lane.total_delay_ns.load() / result.executed / 1000
+            : 0;
+    result.max_delay_us = lane.max_delay_ns.load() / 1000;
+    return result;
+}
+
+// 加权轮转选lane的顺序：每7次里Interactive 4次、Normal 2次、
+// Background 1次，交错排开。选中的lane空了再按优先级找其他lane，
+// 所以低优先级的lane有任务时至少能分到这个比例，不会饿死
+inline size_t ThreadPool::scheduled_lane(size_t turn) {
+    static const size_t schedule[] = {0, 1, 0, 2, 0, 1, 0};
+    return schedule[turn % (sizeof(schedule) / sizeof(schedule[0]))];
+}
+
+inline ThreadPool *&ThreadPool::current_pool() {
+    static thread_local ThreadPool *current = nullptr;
+    return current;
+}
+
+// 环形队列满时：工作线程放进spill，spill也满了直接执行，
+// 不申请内存也不会互相等待；外部线程在space上等工作线程腾出位置。
+// 析构时还在等的任务直接丢弃
+inline void ThreadPool::push(Lane &lane, Job &&job) {
+    if (lane.jobs.try_enqueue(std::move(job)))
+        return;
+    if (current_pool() == this) {
+        if (!lane.spill.try_enqueue(std::move(job)))
+            run_job(lane, job);
+        return;
+    }
+    while (true) {
+        EventCount::Key key = space.prepareWait();
+        if (lane.jobs.try_enqueue(std::move(job)) || stop.load()) {
+            space.cancelWait();
+            return;
+        }
+        space.wait(key);
+    }
+}
+
+inline bool ThreadPool::pop(Lane &lane, Job &job) {
+    return lane.jobs.try_dequeue(job) || lane.spill.try_dequeue(job);
+}
+
+// 一次取出按线程数平分的一份，最多kMaxBatch个，
+// 剩下的留给其他线程，不让一个线程攒着一批任务串行执行
+inline size_t ThreadPool::take(Lane &lane, Job *batch) {
+    size_t share = (lane.jobs.size() + num_workers - 1) / num_workers;
+    size_t max_count = share < kMaxBatch ? share : kMaxBatch;
+    size_t n = 0;
+    if (max_count > 1)
+        n = lane.jobs.try_dequeue_bulk(batch, max_count);
+    if (n == 0 && pop(lane, batch[0]))
+        n = 1;
+    return n;
+}
+
+// 开始执行时才检查截止时间，同一批前面的任务执行久了，
+// 后面的任务也可能过期。排队时间太长说明线程不够，弹性模式下加线程
+inline void ThreadPool::run_job(Lane &lane, Job &job) {
+    Clock::time_point now = Clock::now();
+    if (min_workers < max_workers)
+        last_progress.store(now.time_since_epoch().count(),
+                            std::memory_order_relaxed);
+    if (now - job.enqueued > grow_delay)
+        maybe_grow(now);
+    if (now > job.deadline) {
+        lane.dropped.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        uint64_t delay = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                now - job.enqueued)
+                .count());
+        lane.executed.fetch_add(1, std::memory_order_relaxed);
+        lane.total_delay_ns.fetch_add(delay, std::memory_order_relaxed);
+        uint64_t max_delay = lane.max_delay_ns.load(std::memory_order_relaxed);
+        while (delay > max_delay &&
+               !lane.max_delay_ns.compare_exchange_weak(max_delay, delay)) {
+        }
+        job.task();
+    }
+    job.task.reset(); // 及时释放任务捕获的对象
+}
+
+inline bool ThreadPool::has_work() const {
+    for (const Lane &lane : lanes) {
+        if (!lane.jobs.empty() || !lane.spill.empty())
+            return true;
+    }
+    return false;
+}
+
+// 提交任务前检查。run_job里的检查要等工作线程取出任务才会做，
+// 所有线程都卡在长任务里时没人取任务，线程池就一直不会加线程。
+// 提交前队列里已经有任务，而且grow_delay之内没有任务开始执行，
+// 说明排在最前面的任务至少等了grow_delay，这时由提交的线程加线程。
+// 队列原来是空的，就从现在开始算
+inline void ThreadPool::check_grow() {
+    if (min_workers == max_workers)
+        return;
+    Clock::time_point now = Clock::now();
+    Clock::rep rep = now.time_since_epoch().count();
+    if (!has_work())
+        last_progress.store(rep, std::memory_order_relaxed);
+    else if (rep - last_progress.load(std::memory_order_relaxed) >
+             grow_delay.count())
+        maybe_grow(now);
+}
+
+// 每次最多加一个线程，grow_interval之内只有抢到last_grow的线程能加
+inline void ThreadPool::maybe_grow(Clock::time_point now) {
+    if (num_workers.load(std::memory_order_relaxed) >= max_workers)
+        return;
+    Clock::rep last = last_grow.load();
+    if (now.time_since_epoch().count() - last < grow_interval.count() ||
+        !last_grow.compare_exchange_strong(last,
+                                           now.time_since_epoch().count()))
+        return;
+
+    std::lock_guard<std::mutex> lock(workers_mutex);
+    if (stop.load() || num_workers.load() >= max_workers)
+        return;
+    // 顺便join已经退出的线程，它们已经离开工作循环，join很快返回
+    for (std::thread::id id : exited) {
+        for (size_t i = 0; i < workers.size(); ++i) {
+            if (workers[i].get_id() == id) {
+                workers[i].join();
+                workers.erase(workers.begin() + i);
+                break;
+            }
+        }
+    }
+    exited.clear();
+    num_workers.fetch_add(1);
+    workers.emplace_back([this] { worker_thread(); });
+}
+
+// 线程数大于min_workers时让当前线程退出
+inline bool ThreadPool::try_retire() {
+    size_t n = num_workers.load();
+    while (n > min_workers) {
+        if (num_workers.compare_exchange_weak(n, n - 1)) {
+            std::lock_guard<std::mutex> lock(workers_mutex);
+            exited.push_back(std::this_thread::get_id());
+            return true;
+        }
+    }
+    return false;
+}
+
+// 空闲线程可以退出的时间：自己空闲了idle_timeout，
+// 而且线程池最近idle_timeout之内没有加过线程
+inline ThreadPool::Clock::time_point
+ThreadPool::retire_time(Clock::time_point idle_since) const {
+    Clock::time_point grown =
+        Clock::time_point(Clock::duration(last_grow.load()));
+    return std::max(idle_since, grown) + idle_timeout;
+}
+
+// 工作线程函数，按加权轮转从各lane取出任务并执行；
+// 队列空了先让出CPU自旋几轮，还是没有任务就睡眠，空闲时不占CPU。
+// 弹性模式下线程数多于min_workers时睡眠有超时，空闲够久的线程退出
 inline void ThreadPool::worker_thread() {
+    current_pool() = this;
+    Job batch[kMaxBatch];
+    size_t turn = 0;
+    int spins = 0;
+    Clock::time_point idle_since;
     while (!stop.load()) {
-        std::function<void()> *task;
-        if (tasks.pop(task)) {
-            (*task)();
-            delete task;
-        } else {
+        size_t first = scheduled_lane(turn++);
+        Lane *lane = &lanes[first];
+        size_t n = take(*lane, batch);
+        for (size_t i = 0; i < kNumLanes && n == 0; ++i) {
+            if (i == first)
+                continue;
+            lane = &lanes[i];
+            n = take(*lane, batch);
+        }
+        if (n > 0) {
+            // 腾出了位置，唤醒等着提交的外部线程
+            space.notify(static_cast<int>(n));
+            for (size_t i = 0; i < n; ++i)
+                run_job(*lane, batch[i]);
+            spins = 0;
+        } else if (spins < kSpinRounds) {
+            if (spins++ == 0 && min_workers < max_workers)
+                idle_since = Clock::now();
             std::this_thread::yield(); // 防止 busy waiting
+        } else {
+            // 登记为等待者之后再检查一次，这之间enqueue的任务不会漏掉
+            EventCount::Key key = idle.prepareWait();
+            if (has_work() || stop.load()) {
+                idle.cancelWait();
+            } else if (num_workers.load() <= min_workers) {
+                // 不能再减线程，一直睡到有任务
+                idle.wait(key);
+            } else if (!idle.waitFor(key,
+                                     retire_time(idle_since) - Clock::now())) {
+                // 超时时可能刚好被算作唤醒对象，有任务就不能退出
+                if (!has_work() && !stop.load() &&
+                    Clock::now() >= retire_time(idle_since) && try_retire()) {
+                    current_pool() = nullptr;
+                    return;
+                }
+                continue; // 还没到退出的时间，接着睡，不重置idle_since
+            }
+            spins = 0;
         }
     }
+    current_pool() = nullptr;
 }
 
 } // namespace ThreadPool
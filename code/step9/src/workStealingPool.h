@@ -0,0 +1,349 @@
+#pragma once
+
+#include "chaseLevDeque.h"
+#include "eventCount.h"
+#include "inlineTask.h"
+#include "mpmcQueue.h"
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace ThreadPool {
+
+// 工作窃取线程池，enqueue接口与ThreadPool相同。
+// 每个工作线程有一个Chase-Lev双端队列：工作线程自己提交的任务压在
+// 自己队列的bottom端，后进先出，刚产生的任务数据还在cache里；
+// 空闲的工作线程随机挑线程从它队列的top端偷任务。
+// 非工作线程（比如事件循环线程）提交的任务轮流放进各工作线程的收件箱，
+// 收件箱是有界环形队列，任务按值放在槽位里，提交时不申请内存，
+// 提交线程之间也不再争同一个队列头；满了就换下一个收件箱。
+// Chase-Lev队列只能放指针，工作线程自己提交的任务放在本线程预先分配的
+// 槽位里，队列里存槽位的指针；槽位用完了放进自己的收件箱，
+// 收件箱也满了就直接执行，提交时都不申请内存。
+// 从收件箱取任务时一次取按线程数平分的一份放在本线程的缓冲区里。
+// 工作线程按 自己的队列 -> 自己的收件箱 -> 随机偷其他线程 的顺序取任务，
+// 都取不到时先让出CPU重试几轮，再在idle上睡眠，提交任务时唤醒一个。
+class WorkStealingPool {
+  public:
+    WorkStealingPool(size_t num_threads);
+    ~WorkStealingPool();
+
+    // 添加任务到线程池
+    template <class F, class... Args>
+    auto enqueue(F &&f, Args &&...args) -> std::future<decltype(f(args...))>;
+
+    // 提交不需要返回值的任务，不创建packaged_task和future
+    template <class F> void post(F &&f);
+
+    // 批量版本，外部线程提交时整批用一次CAS放进一个收件箱，只唤醒一次。
+    // enqueue_bulk的元素是无参数的可调用对象；
+    // post_bulk的元素是InlineTask，会被移走，It要求是随机访问迭代器
+    template <class It>
+    auto enqueue_bulk(It first, It last)
+        -> std::vector<std::future<decltype((*first)())>>;
+    template <class It> void post_bulk(It first, It last);
+
+  private:
+    using Task = InlineTask;
+
+    // 空闲时每轮随机尝试窃取的次数
+    static const size_t kStealAttempts = 4;
+    // 取不到任务时先重试的轮数，之后睡眠
+    static const int kSpinRounds = 64;
+    // 每个收件箱的槽位数
+    static const size_t kInboxCapacity = 256;
+    // 一次从收件箱最多取出的任务数
+    static const size_t kMaxBatch = 8;
+    // 每个工作线程的任务槽位数，Chase-Lev队列的初始容量与它相同，不会扩容
+    static const size_t kSlotCount = 256;
+
+    // 取走任务的线程（所属线程或窃取者）把任务移出来以后清掉busy，
+    // 所属线程看到busy为false才重新使用这个槽位
+    struct TaskSlot {
+        TaskSlot() : busy(false) {}
+
+        Task task;
+        std::atomic<bool> busy;
+    };
+
+    struct Worker {
+        Worker()
+            : deque(kSlotCount), inbox(kInboxCapacity), next_slot(0),
+              batch_next(0), batch_size(0), rng(0) {}
+
+        ChaseLevDeque<TaskSlot> deque;
+        MPMCQueue<Task> inbox;
+        TaskSlot slots[kSlotCount];
+        size_t next_slot; // 下次从这里开始找空闲槽位，只有本线程访问
+        // 从收件箱批量取出、还没执行的任务，只有本线程访问
+        Task batch[kMaxBatch];
+        size_t batch_next;
+        size_t batch_size;
+        uint32_t rng; // 选择窃取对象用的xorshift状态
+        std::thread thread;
+    };
+
+    // Worker里的队列头尾按cache line对齐，C++11的new只保证
+    // alignof(max_align_t)，Worker用posix_memalign分配，由它释放
+    struct WorkerDeleter {
+        void operator()(Worker *worker) const {
+            worker->~Worker();
+            free(worker);
+        }
+    };
+    using WorkerPtr = std::unique_ptr<Worker, WorkerDeleter>;
+    static WorkerPtr new_worker();
+
+    // 当前线程所属的线程池和工作线程下标，非工作线程为nullptr
+    struct CurrentWorker {
+        WorkStealingPool *pool;
+        size_t index;
+    };
+    static CurrentWorker &current_worker();
+
+    void submit(Task &&task);
+    void push_local(Worker &self, Task &&task);
+    static void release(TaskSlot *slot, Task &task);
+    bool take(size_t index, Task &task);
+    bool steal(size_t index, Task &task);
+    bool has_work() const;
+    void worker_thread(size_t index);
+
+    std::vector<WorkerPtr> workers;
+    std::atomic<size_t> next_inbox; // 外部提交时轮流选择收件箱
+    std::atomic<bool> stop;
+    EventCount idle; // 空闲工作线程在这里睡眠
+};
+
+inline WorkStealingPool::WorkStealingPool(size_t num_threads)
+    : next_inbox(0), stop(false) {
+    if (num_threads == 0)
+        num_threads = 1;
+    // 先建好所有队列再启动线程，工作线程一启动就可能去偷别人的队列
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers.push_back(new_worker());
+        workers[i]->rng = static_cast<uint32_t>(i * 2654435761u + 1);
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers[i]->thread = std::thread([this, i] { worker_thread(i); });
+    }
+}
+
+// 析构函数，等待所有线程退出；还没执行的任务随槽位和收件箱一起销毁，
+// 对应的future会收到broken_promise
+inline WorkStealingPool::~WorkStealingPool() {
+    stop.store(true);
+    idle.notifyAll();
+    for (WorkerPtr &worker : workers)
+        worker->thread.join();
+}
+
+inline WorkStealingPool::WorkerPtr WorkStealingPool::new_worker() {
+    void *p = nullptr;
+    if (posix_memalign(&p, alignof(Worker), sizeof(Worker)) != 0)
+        throw std::bad_alloc();
+    try {
+        return WorkerPtr(new (p) Worker());
+    } catch (...) {
+        free(p);
+        throw;
+    }
+}
+
+inline WorkStealingPool::CurrentWorker &WorkStealingPool::current_worker() {
+    static thread_local CurrentWorker current = {nullptr, 0};
+    return current;
+}
+
+// 添加任务到线程池
+template <class F, class... Args>
+auto WorkStealingPool::enqueue(F &&f, Args &&...args)
+    -> std::future<decltype(f(args...))> {
+    using return_type = decltype(f(args...));
+    // 创建一个任务指向的智能指针，使它可以异步地获取值或异常
+    auto task = std::make_shared<std::packaged_task<return_type()>>(
+        std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+
+    std::future<return_type> res = task->get_future();
+    submit(Task([task]() { (*task)(); }));
+    return res;
+}
+
+template <class F> void WorkStealingPool::post(F &&f) {
+    submit(Task(std::forward<F>(f)));
+}
+
+template <class It>
+auto WorkStealingPool::enqueue_bulk(It first, It last)
+    -> std::vector<std::future<decltype((*first)())>> {
+    using return_type = decltype((*first)());
+    std::vector<std::future<return_type>> res;
+    std::vector<Task> batch;
+    for (; first != last; ++first) {
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+            std::move(*first));
+        res.push_back(task->get_future());
+        batch.emplace_back([task]() { (*task)(); });
+    }
+    post_bulk(batch.begin(), batch.end());
+    return res;
+}
+
+// 一个收件箱放不下时剩下的放进下一个
+template <class It> void WorkStealingPool::post_bulk(It first, It last) {
+    size_t count = static_cast<size_t>(last - first);
+    if (count == 0)
+        return;
+    CurrentWorker &current = current_worker();
+    if (current.pool == this) {
+        for (It it = first; it != last; ++it)
+            push_local(*workers[current.index], Task(std::move(*it)));
+    } else {
+        const size_t n = workers.size();
+        size_t index = next_inbox.fetch_add(1, std::memory_order_relaxed);
+        for (size_t i = 0; first != last; ++i) {
+            first += workers[(index + i) % n]->inbox.try_enqueue_bulk(
+                first, static_cast<size_t>(last - first));
+            if (first != last && i % n == n - 1)
+                std::this_thread::yield();
+        }
+    }
+    idle.notify(static_cast<int>(count));
+}
+
+// 工作线程提交的任务也要唤醒睡眠的线程，让它们来偷；
+// 所有收件箱都满时让出CPU等工作线程取走任务
+inline void WorkStealingPool::submit(Task &&task) {
+    CurrentWorker &current = current_worker();
+    if (current.pool == this) {
+        push_local(*workers[current.index], std::move(task));
+    } else {
+        const size_t n = workers.size();
+        size_t index = next_inbox.fetch_add(1, std::memory_order_relaxed);
+        for (size_t i = 0;; ++i) {
+            if (workers[(index + i) % n]->inbox.try_enqueue(std::move(task)))
+                break;
+            if (i % n == n - 1)
+                std::this_thread::yield();
+        }
+    }
+    idle.notifyOne();
+}
+
+// 从next_slot开始找空闲槽位。队列里已经有kSlotCount个任务时槽位全被
+// 占着，不用找；这时不能等别人腾位置，放不进收件箱就直接执行
+inline void WorkStealingPool::push_local(Worker &self, Task &&task) {
+    size_t limit = self.deque.size() < kSlotCount ? kSlotCount : 0;
+    for (size_t i = 0; i < limit; ++i) {
+        TaskSlot &slot = self.slots[(self.next_slot + i) % kSlotCount];
+        if (!slot.busy.load(std::memory_order_acquire)) {
+            self.next_slot = (self.next_slot + i + 1) % kSlotCount;
+            slot.task = std::move(task);
+            slot.busy.store(true, std::memory_order_relaxed);
+            self.deque.push(&slot);
+            return;
+        }
+    }
+    if (!self.inbox.try_enqueue(std::move(task)))
+        task();
+}
+
+inline void WorkStealingPool::release(TaskSlot *slot, Task &task) {
+    task = std::move(slot->task);
+    slot->busy.store(false, std::memory_order_release);
+}
+
+// 从Chase-Lev队列取到的任务移出槽位后归还槽位
+inline bool WorkStealingPool::take(size_t index, Task &task) {
+    Worker &self = *workers[index];
+    if (self.batch_next < self.batch_size) {
+        task = std::move(self.batch[self.batch_next++]);
+        return true;
+    }
+    if (TaskSlot *slot = self.deque.pop()) {
+        release(slot, task);
+        return true;
+    }
+    // 收件箱里的任务取按线程数平分的一份，其余留给窃取者
+    size_t share = (self.inbox.size() + workers.size() - 1) / workers.size();
+    if (share > 1) {
+        size_t n = self.inbox.try_dequeue_bulk(
+            self.batch, share < kMaxBatch ? share : kMaxBatch);
+        if (n > 0) {
+            task = std::move(self.batch[0]);
+            self.batch_next = 1;
+            self.batch_size = n;
+            return true;
+        }
+    }
+    if (self.inbox.try_dequeue(task))
+        return true;
+    return steal(index, task);
+}
+
+// 随机挑kStealAttempts次窃取对象，先偷它的队列再取它的收件箱；
+// 一轮不全部扫一遍，空闲线程多时每轮的开销不随线程数增长
+inline bool WorkStealingPool::steal(size_t index, Task &task) {
+    const size_t n = workers.size();
+    if (n == 1)
+        return false;
+    uint32_t &rng = workers[index]->rng;
+    for (size_t i = 0; i < kStealAttempts; ++i) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        size_t victim = rng % n;
+        if (victim == index)
+            continue;
+        if (TaskSlot *slot = workers[victim]->deque.steal()) {
+            release(slot, task);
+            return true;
+        }
+        if (workers[victim]->inbox.try_dequeue(task))
+            return true;
+    }
+    return false;
+}
+
+// 是否还有任何队列或收件箱不为空，睡眠前用来再检查一次
+inline bool WorkStealingPool::has_work() const {
+    for (const WorkerPtr &worker : workers) {
+        if (worker->deque.size() > 0 || !worker->inbox.empty())
+            return true;
+    }
+    return false;
+}
+
+// 工作线程函数，取出任务并执行
+inline void WorkStealingPool::worker_thread(size_t index) {
+    CurrentWorker &current = current_worker();
+    current.pool = this;
+    current.index = index;
+    int spins = 0;
+    while (!stop.load()) {
+        Task task;
+        if (take(index, task)) {
+            task();
+            spins = 0;
+        } else if (spins < kSpinRounds) {
+            ++spins;
+            std::this_thread::yield(); // 防止 busy waiting
+        } else {
+            // 登记为等待者之后再检查一次，这之间提交的任务不会漏掉
+            EventCount::Key key = idle.prepareWait();
+            if (has_work() || stop.load()) {
+                idle.cancelWait();
+            } else {
+                idle.wait(key);
+            }
+            spins = 0;
+        }
+    }
+    current.pool = nullptr;
+}
+
+} // namespace ThreadPool